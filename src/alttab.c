@@ -27,6 +27,9 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 #include <string.h>
 #include <time.h>
 #include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/select.h>
 #include "alttab.h"
 #include "util.h"
 #include "config.h"
@@ -81,6 +84,7 @@ Options:\n\
    -ns        ignore window request to skip it in taskbar\n\
   -v|-vv      verbose\n\
     -h        help\n\
+Icon index: alttab -mkindex [-theme name] [-i NxM] [-v|-vv]\n\
 See man alttab for details.\n", PACKAGE_VERSION);
     exit(0);
 }
@@ -106,7 +110,7 @@ static int use_args_and_xrm(int *argc, char **argv)
     char *rm;
     char *empty = "";
     int uo;
-    Atom nwm_prop, atype;
+    Atom atype;
     unsigned char *nwm;
     int form;
     unsigned long remain, len;
@@ -211,8 +215,7 @@ static int use_args_and_xrm(int *argc, char **argv)
         goto wmDone;
     }
 // ratpoison?
-    nwm_prop = XInternAtom(dpy, "_NET_WM_NAME", false);
-    if (XGetWindowProperty(dpy, root, nwm_prop, 0, MAXNAMESZ, false,
+    if (XGetWindowProperty(dpy, root, g.atom[AT_NET_WM_NAME], 0, MAXNAMESZ, false,
                            AnyPropertyType, &atype, &form, &len, &remain,
                            &nwm) == Success && nwm) {
         msg(0, "_NET_WM_NAME root property present: %s\n", nwm);
@@ -530,6 +533,77 @@ static int use_args_and_xrm(int *argc, char **argv)
     return 1;
 }
 
+//
+// fill in g.atom in one round trip
+// return 1 if ok
+//
+static int internAtoms(void)
+{
+    static char *names[NATOMS] = {
+        [AT_UTF8_STRING] = "UTF8_STRING",
+        [AT_NET_CLIENT_LIST] = "_NET_CLIENT_LIST",
+        [AT_NET_CLIENT_LIST_STACKING] = "_NET_CLIENT_LIST_STACKING",
+        [AT_WIN_CLIENT_LIST] = "_WIN_CLIENT_LIST",
+        [AT_NET_SUPPORTING_WM_CHECK] = "_NET_SUPPORTING_WM_CHECK",
+        [AT_WIN_SUPPORTING_WM_CHECK] = "_WIN_SUPPORTING_WM_CHECK",
+        [AT_NET_WM_NAME] = "_NET_WM_NAME",
+        [AT_NET_ACTIVE_WINDOW] = "_NET_ACTIVE_WINDOW",
+        [AT_NET_CURRENT_DESKTOP] = "_NET_CURRENT_DESKTOP",
+        [AT_WIN_WORKSPACE] = "_WIN_WORKSPACE",
+        [AT_NET_WM_DESKTOP] = "_NET_WM_DESKTOP",
+        [AT_NET_WM_STATE] = "_NET_WM_STATE",
+        [AT_NET_WM_STATE_HIDDEN] = "_NET_WM_STATE_HIDDEN",
+        [AT_NET_WM_STATE_SKIP_TASKBAR] = "_NET_WM_STATE_SKIP_TASKBAR",
+        [AT_NET_WM_PID] = "_NET_WM_PID",
+        [AT_NET_WM_ICON] = "_NET_WM_ICON",
+        [AT_NET_WM_WINDOW_TYPE] = "_NET_WM_WINDOW_TYPE",
+        [AT_NET_WM_WINDOW_TYPE_DIALOG] = "_NET_WM_WINDOW_TYPE_DIALOG",
+        [AT_MOTIF_WM_HINTS] = "_MOTIF_WM_HINTS",
+        [AT_WM_CLIENT_LEADER] = "WM_CLIENT_LEADER",
+    };
+
+    return XInternAtoms(dpy, names, NATOMS, False, g.atom) != 0;
+}
+
+//
+// -mkindex: build icon index and exit.
+// doesn't connect to X, so it may run at package installation time.
+// return exit code
+//
+static int mkindexMode(int argc, char **argv)
+{
+    int arg, x, y, xpg;
+    unsigned int w, h;
+    const char *inv = "invalid %s, use -h for help\n";
+
+    g.debug = 0;
+    g.option_theme = DEFTHEME;
+    g.option_iconW = DEFICONW;
+    g.option_iconH = DEFICONH;
+    for (arg = 2; arg < argc; arg++) {
+        if (strcmp(argv[arg], "-v") == 0) {
+            g.debug = 1;
+        } else if (strcmp(argv[arg], "-vv") == 0) {
+            g.debug = 2;
+        } else if (strcmp(argv[arg], "-theme") == 0 && arg + 1 < argc) {
+            g.option_theme = argv[++arg];
+        } else if (strcmp(argv[arg], "-i") == 0 && arg + 1 < argc) {
+            xpg = XParseGeometry(argv[++arg], &x, &y, &w, &h);
+            if (!(xpg & WidthValue) || !(xpg & HeightValue) || w == 0
+                || h == 0)
+                die(inv, "icon geometry");
+            g.option_iconW = w;
+            g.option_iconH = h;
+        } else {
+            die(inv, argv[arg]);
+        }
+    }
+    msg(0, "building icon index: theme %s, %dx%d icon\n",
+        g.option_theme, g.option_iconW, g.option_iconH);
+    // root builds system-wide index, others their own
+    return buildIconIndex(geteuid() == 0) ? 0 : 1;
+}
+
 //
 // grab Alt-Tab and Alt-Shift-Tab
 // note: exit() on failure
@@ -578,10 +652,55 @@ static int isPrevNextKey(unsigned int keycode)
         continue; \
     }
 
+//
+// block until X event is available,
+// doing icon work meanwhile: installing background-built hash,
+// warming up icons, applying changes of icon dirs
+//
+static void waitForXEvent(void)
+{
+    int xfd, ifd;
+    fd_set fds;
+    struct timeval tv;
+    bool ready;
+
+    xfd = ConnectionNumber(dpy);
+    while (XPending(dpy) == 0) {
+        // tiles may use icon pixmaps while ui is shown
+        if (g.uiShowHasRun)
+            return;
+        ready = pollIconHash(false);
+        // one icon at a time, then check for X events again
+        if (ready && warmupIcons())
+            continue;
+        ifd = ready ? iconWatchFd() : -1;
+        FD_ZERO(&fds);
+        FD_SET(xfd, &fds);
+        if (ifd >= 0)
+            FD_SET(ifd, &fds);
+        // while the hash is built, look at it from time to time
+        tv.tv_sec = 0;
+        tv.tv_usec = 100000;
+        if (select((xfd > ifd ? xfd : ifd) + 1, &fds, NULL, NULL,
+                   ready ? NULL : &tv) < 0) {
+            if (errno == EINTR)
+                continue;
+            msg(-1, "select: %s\n", strerror(errno));
+            return;
+        }
+        if (ifd >= 0 && FD_ISSET(ifd, &fds))
+            processIconWatch(&(g.ic));
+    }
+}
+
 int main(int argc, char **argv)
 {
 
     XEvent ev;
+
+    if (argc > 1 && strcmp(argv[1], "-mkindex") == 0)
+        return mkindexMode(argc, argv);
+
     dpy = XOpenDisplay(NULL);
     if (!dpy)
         die("can't open display");
@@ -593,6 +712,9 @@ int main(int argc, char **argv)
     XErrorHandler hnd = XSetErrorHandler(zeroErrorHandler); // for entire program
     if (hnd) ;;                 // make -Wunused happy
 
+    if (!internAtoms())
+        die("can't intern atoms");
+
     signal(SIGUSR1, sighandler);
 
     if (!use_args_and_xrm(&argc, argv))
@@ -628,6 +750,7 @@ int main(int argc, char **argv)
             }
         } else {
             // event: immediate, when we don't care about Alt release
+            waitForXEvent();
             XNextEvent(dpy, &ev);
         }
 
@@ -697,9 +820,29 @@ int main(int argc, char **argv)
             break;
 
         case DestroyNotify:
+            x_treeEvent(&ev);
             winDestroyEvent(ev.xdestroywindow);
             break;
 
+        case ConfigureNotify:
+            x_treeEvent(&ev);
+            winConfigureEvent(ev.xconfigure);
+            if (g.uiShowHasRun)
+                uiConfigureEvent(ev.xconfigure);
+            break;
+
+        case ReparentNotify:
+            x_treeEvent(&ev);
+            winReparentEvent(ev.xreparent);
+            break;
+
+        case CreateNotify:
+        case MapNotify:
+        case UnmapNotify:
+        case CirculateNotify:
+            x_treeEvent(&ev);
+            break;
+
         case FocusIn:
             winFocusChangeEvent(ev.xfocus);
             break;
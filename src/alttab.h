@@ -86,7 +86,8 @@ typedef struct {
     Pixmap icon_drawable;       // Window or Pixmap
     Pixmap icon_mask;
     unsigned int icon_w, icon_h;
-    bool icon_allocated;        // we must free icon, because we created it (placeholder or depth conversion)
+    bool icon_allocated;        // we must release icon, because we created it and it's not in g.wicon
+    icon_t *icon_file;          // drawable comes from this file icon, see fitWinlistIcons
 #ifdef ICON_DEBUG
     char icon_src[MAXNAMESZ];
 #endif
@@ -95,6 +96,8 @@ typedef struct {
 // because WMs set it to these values incoherently
 #define DESKTOP_UNKNOWN 0xdead
     unsigned long desktop;
+    int order;                  // position in sortlist, see sortWinlist
+    bool minimized;             // _NET_WM_STATE_HIDDEN, for option_sort_minimize
 } WindowInfo;
 
 typedef struct {
@@ -111,12 +114,43 @@ typedef struct {
     bool minus1_desktop_unusable;
 } EwmhFeatures;
 
-// uthash doubly-linked list element
+// utlist doubly-linked list element,
+// also indexed by id in uthash, see addToSortlist
 typedef struct PermanentWindowInfo {
     Window id;
+    int rank;                   // position in list, see sortWinlist
+    bool alive;                 // for compactSortlist
     struct PermanentWindowInfo *next, *prev;
+    UT_hash_handle hh;
 } PermanentWindowInfo;
 
+// icon source decision for WM_CLASS, uthash element.
+// shared by all windows of the class, see addIconFromFiles
+typedef struct ClassIcon {
+    char *wmclass;              // WM_CLASS value, "instance\0class\0"; uthash key
+    unsigned long size;
+    bool nofile;                // no file icon for any name in wmclass
+    unsigned int nofile_gen;    // ... in this iconHashGeneration
+    bool file_wins;             // file icon was chosen over icon from X (-s 2, 3)
+    UT_hash_handle hh;
+} ClassIcon;
+
+// icon of the window from _NET_WM_ICON or WM_HINTS, uthash element.
+// unlike WindowInfo, survives uiHide, see addIconFromX
+typedef struct WindowIcon {
+    Window id;                  // uthash key
+    Pixmap drawable;            // 0 if window has no usable icon
+    Pixmap mask;
+    unsigned int w, h;
+    bool allocated;             // drawable was created by us, not by client
+    bool stale;                 // property changed, fetch again on next uiShow
+    ClassIcon *cls;             // NULL until WM_CLASS is read
+#ifdef ICON_DEBUG
+    char src[MAXNAMESZ];
+#endif
+    UT_hash_handle hh;
+} WindowIcon;
+
 /*
 typedef struct SwitchMoment {
     Window prev;
@@ -208,7 +242,30 @@ typedef struct {
     unsigned int ignored_modmask;
     icon_t *ic;                 // cache of all icons
     EwmhFeatures ewmh;          // guessed by ewmh_detectFeatures
-    Atom naw;                   // _NET_ACTIVE_WINDOW
+// atoms interned once at startup, index in "atom"
+#define AT_UTF8_STRING                      0
+#define AT_NET_CLIENT_LIST                  1
+#define AT_NET_CLIENT_LIST_STACKING         2
+#define AT_WIN_CLIENT_LIST                  3
+#define AT_NET_SUPPORTING_WM_CHECK          4
+#define AT_WIN_SUPPORTING_WM_CHECK          5
+#define AT_NET_WM_NAME                      6
+#define AT_NET_ACTIVE_WINDOW                7
+#define AT_NET_CURRENT_DESKTOP              8
+#define AT_WIN_WORKSPACE                    9
+#define AT_NET_WM_DESKTOP                   10
+#define AT_NET_WM_STATE                     11
+#define AT_NET_WM_STATE_HIDDEN              12
+#define AT_NET_WM_STATE_SKIP_TASKBAR        13
+#define AT_NET_WM_PID                       14
+#define AT_NET_WM_ICON                      15
+#define AT_NET_WM_WINDOW_TYPE               16
+#define AT_NET_WM_WINDOW_TYPE_DIALOG        17
+#define AT_MOTIF_WM_HINTS                   18
+#define AT_WM_CLIENT_LEADER                 19
+#define NATOMS                              20
+    Atom atom[NATOMS];
+    WindowIcon *wicon;          // icons of windows from X and their classes, by window id
 //    SwitchMoment last; // for detecting false focus events from WM
     bool option_keep_ui;
     bool option_sort_minimize;
@@ -223,7 +280,9 @@ int uiNextWindow(void);
 int uiPrevWindow(void);
 int uiKillWindow(void);
 int uiSelectWindow(int ndx);
+void uiForgetTile(Window w);
 void uiButtonEvent(XButtonEvent e);
+void uiConfigureEvent(XConfigureEvent e);
 Window getUiwin(void);
 void shutdownGUI(void);
 
@@ -231,14 +290,17 @@ void shutdownGUI(void);
 int startupWintasks(void);
 int addIconFromProperty(WindowInfo * wi);
 int addIconFromHints(WindowInfo * wi);
-int addIconFromFiles(WindowInfo * wi);
+int addIconFromFiles(WindowInfo * wi, ClassIcon * ci);
 int addWindowInfo(Window win, int reclevel, int wm_id, unsigned long desktop,
                   char *wm_name);
 int initWinlist(void);
 void freeWinlist(void);
 int setFocus(int winNdx);
 int rp_startupWintasks(void);
-int x_initWindowsInfoRecursive(Window win, int reclevel);
+int x_startupWintasks(void);
+int x_initWinlist(void);
+void x_treeEvent(XEvent * ev);
+void x_shutdownWintasks(void);
 int rp_initWinlist(void);
 int x_setFocus(int wndx);
 int rp_setFocus(int winNdx);
@@ -246,17 +308,25 @@ int execAndReadStdout(char *exe, char *args[], char *buf, int bufsize);
 int pulloutWindowToTop(int winNdx);
 void winPropChangeEvent(XPropertyEvent e);
 void winDestroyEvent(XDestroyWindowEvent e);
+void winConfigureEvent(XConfigureEvent e);
+void winReparentEvent(XReparentEvent e);
 void winFocusChangeEvent(XFocusChangeEvent e);
 bool common_skipWindow(Window w, unsigned long current_desktop,
                        unsigned long window_desktop);
 void x_setCommonPropertiesForAnyWindow(Window win);
+void x_addEventMask(Window w, long mask);
 void addToSortlist(Window w, bool to_head, bool move);
+void compactSortlist(Window * keep, int nkeep);
+void queueIconWarmup(Window w);
+int warmupIcons(void);
+void fitWinlistIcons(unsigned int w, unsigned int h);
 void shutdownWin(void);
 
 /* EWHM */
 bool ewmh_detectFeatures(EwmhFeatures * e);
 Window ewmh_getActiveWindow(void);
 int ewmh_initWinlist(void);
+void ewmh_queueIconWarmup(void);
 int ewmh_setFocus(int winNdx, Window fwin); // fwin used if non-zero
 unsigned long ewmh_getCurrentDesktop(void);
 unsigned long ewmh_getDesktopOfWindow(Window w);
@@ -48,7 +48,7 @@ static Window *ewmh_get_client_list(unsigned long *client_list_size)
     if (g.ewmh.try_stacking_list_first) {
         if ((client_list =
              (Window *) get_x_property(root, XA_WINDOW,
-                                       "_NET_CLIENT_LIST_STACKING",
+                                       g.atom[AT_NET_CLIENT_LIST_STACKING],
                                        client_list_size)) != NULL) {
             msg(1, "ewmh found stacking window list\n");
             return client_list;
@@ -59,20 +59,20 @@ static Window *ewmh_get_client_list(unsigned long *client_list_size)
 
     client_list =
         (Window *) get_x_property_alt(root,
-                                      XA_WINDOW, "_NET_CLIENT_LIST",
-                                      XA_CARDINAL, "_WIN_CLIENT_LIST",
+                                      XA_WINDOW, g.atom[AT_NET_CLIENT_LIST],
+                                      XA_CARDINAL, g.atom[AT_WIN_CLIENT_LIST],
                                       client_list_size);
 
     return client_list;
 }
 
-static int ewmh_send_wm_evt(Window w, char *atom, unsigned long edata[])
+static int ewmh_send_wm_evt(Window w, Atom atom, unsigned long edata[])
 {
     XEvent evt;
     long rn_mask = SubstructureRedirectMask | SubstructureNotifyMask;
     evt.xclient.window = w;
     evt.xclient.type = ClientMessage;
-    evt.xclient.message_type = XInternAtom(dpy, atom, False);
+    evt.xclient.message_type = atom;
     evt.xclient.serial = 0;
     evt.xclient.send_event = True;
     evt.xclient.format = 32;
@@ -81,7 +81,7 @@ static int ewmh_send_wm_evt(Window w, char *atom, unsigned long edata[])
     for (ei = 0; ei < 5; ei++)
         evt.xclient.data.l[ei] = edata[ei];
     if (!XSendEvent(dpy, root, False, rn_mask, &evt)) {
-        msg(-1, "can't send %s xevent\n", atom);
+        msg(-1, "can't send xevent %lu\n", atom);
         return 0;
     }
     return 1;
@@ -94,12 +94,15 @@ static int ewmh_switch_desktop(unsigned long desktop)
     if (desktop == -1 && g.ewmh.minus1_desktop_unusable)
         return 0;
     msg(1, "ewmh switching desktop to %ld\n", desktop);
-    evr = ewmh_send_wm_evt(root, "_NET_CURRENT_DESKTOP", edata);
+    evr = ewmh_send_wm_evt(root, g.atom[AT_NET_CURRENT_DESKTOP], edata);
     if (evr == 0)
         return 0;
     // wait for WM (#45)
 #define WM_POLL_TIMEOUT   200000    // 200 ms
 #define WM_POLL_INTERVAL   10000
+    // events aren't processed in this loop: read from X, not kept values
+    forgetProperty(root, g.atom[AT_NET_CURRENT_DESKTOP]);
+    forgetProperty(root, g.atom[AT_WIN_WORKSPACE]);
     for (elapsed = 0;
          elapsed < WM_POLL_TIMEOUT
          && ewmh_getCurrentDesktop() != desktop; elapsed += WM_POLL_INTERVAL) {
@@ -113,7 +116,7 @@ static int ewmh_switch_window(unsigned long window)
 {
     unsigned long edata[] = { 2, CurrentTime, 0, 0, 0 };
     msg(1, "ewmh switching window to 0x%lx\n", window);
-    return ewmh_send_wm_evt(window, "_NET_ACTIVE_WINDOW", edata);
+    return ewmh_send_wm_evt(window, g.atom[AT_NET_ACTIVE_WINDOW], edata);
 }
 
 // PUBLIC
@@ -126,7 +129,6 @@ bool ewmh_detectFeatures(EwmhFeatures * e)
 {
     Window *chld_win;
     char *r;
-    Atom utf8string;
     char *default_wm_name = "unknown_ewmh_compatible";
     unsigned long client_list_size;
     Window *client_list;
@@ -151,19 +153,17 @@ bool ewmh_detectFeatures(EwmhFeatures * e)
 
     // then, guess/devise WM name
     chld_win = (Window *)get_x_property_alt(root,
-                                            XA_WINDOW, "_NET_SUPPORTING_WM_CHECK",
-                                            XA_CARDINAL, "_WIN_SUPPORTING_WM_CHECK",
+                                            XA_WINDOW, g.atom[AT_NET_SUPPORTING_WM_CHECK],
+                                            XA_CARDINAL, g.atom[AT_WIN_SUPPORTING_WM_CHECK],
                                             NULL);
     if (!chld_win) {
         e->wmname = default_wm_name;
         return true;
     }
 
-    utf8string = XInternAtom(dpy, "UTF8_STRING", False);
-
     r = get_x_property_alt(*chld_win,
-                       utf8string, "_NET_WM_NAME",
-                       XA_STRING, "_NET_WM_NAME", NULL);
+                       g.atom[AT_UTF8_STRING], g.atom[AT_NET_WM_NAME],
+                       XA_STRING, g.atom[AT_NET_WM_NAME], NULL);
     free(chld_win);
 
     e->wmname = (r != NULL) ? r : default_wm_name;
@@ -183,7 +183,7 @@ Window ewmh_getActiveWindow(void)
     Window w = (Window) 0;
     char *awp;
     unsigned long sz;
-    if ((awp = get_x_property(root, XA_WINDOW, "_NET_ACTIVE_WINDOW", &sz))) {
+    if ((awp = get_x_property(root, XA_WINDOW, g.atom[AT_NET_ACTIVE_WINDOW], &sz))) {
         w = *((Window *) awp);
         free(awp);
     } else {
@@ -192,6 +192,53 @@ Window ewmh_getActiveWindow(void)
     return w;
 }
 
+//
+// request root properties which ewmh_initWinlist reads in one batch.
+// root is watched, so it is done only after they change
+//
+static void ewmh_prefetchRoot(void)
+{
+    Atom props[] = {
+        g.atom[AT_NET_CLIENT_LIST_STACKING],
+        g.atom[AT_NET_CLIENT_LIST],
+        g.atom[AT_WIN_CLIENT_LIST],
+        g.atom[AT_NET_CURRENT_DESKTOP],
+        g.atom[AT_WIN_WORKSPACE],
+        g.atom[AT_NET_ACTIVE_WINDOW],
+    };
+
+    prefetchProperties(&root, 1, props, sizeof(props) / sizeof(props[0]));
+}
+
+//
+// request all properties which ewmh_initWinlist and addWindowInfo
+// read for every client in one batch,
+// instead of a round trip per property per client
+//
+static void ewmh_prefetchClients(Window * client_list, int nclients)
+{
+    Atom props[8];
+    int np = 0, i;
+
+    // clients not in winlist (f.e. on other desktop) are watched too,
+    // so that their properties are kept
+    for (i = 0; i < nclients; i++)
+        if (!watchingProperties(client_list[i]))
+            x_setCommonPropertiesForAnyWindow(client_list[i]);
+
+    if (!g.option_no_skip_taskbar)
+        props[np++] = g.atom[AT_NET_WM_STATE];
+    props[np++] = g.atom[AT_NET_WM_DESKTOP];
+    props[np++] = g.atom[AT_WIN_WORKSPACE];
+    props[np++] = XA_WM_NAME;
+    props[np++] = g.atom[AT_NET_WM_NAME];
+    if (g.option_iconSrc != ISRC_RAM && g.option_iconSrc != ISRC_NONE)
+        props[np++] = XA_WM_CLASS;
+    if (g.option_bottom_line == BL_USER)
+        props[np++] = g.atom[AT_NET_WM_PID];
+    prefetchProperties(client_list, nclients, props, np);
+}
+
 //
 // initialize winlist, correcting sortlist
 // return 1 if ok
@@ -205,6 +252,7 @@ int ewmh_initWinlist(void)
     char *title;
     unsigned long current_desktop, window_desktop;
 
+    ewmh_prefetchRoot();
     current_desktop = ewmh_getCurrentDesktop();
 
     aw = ewmh_getActiveWindow();
@@ -218,6 +266,10 @@ int ewmh_initWinlist(void)
         msg(-1, "can't get client list\n");
         return 0;
     }
+    // forget windows whose DestroyNotify was missed
+    compactSortlist(client_list, client_list_size / sizeof(Window));
+    // kept for watched windows only, see initWinlist
+    ewmh_prefetchClients(client_list, client_list_size / sizeof(Window));
 
     for (i = 0; i < client_list_size / sizeof(Window); i++) {
         Window w = client_list[i];
@@ -230,9 +282,9 @@ int ewmh_initWinlist(void)
             continue;
 
         // build title
-        char *wmn1 = get_x_property(w, XA_STRING, "WM_NAME", NULL);
-        Atom utf8str = XInternAtom(dpy, "UTF8_STRING", False);
-        char *wmn2 = get_x_property(w, utf8str, "_NET_WM_NAME", NULL);
+        char *wmn1 = get_x_property(w, XA_STRING, XA_WM_NAME, NULL);
+        char *wmn2 = get_x_property(w, g.atom[AT_UTF8_STRING],
+                                    g.atom[AT_NET_WM_NAME], NULL);
         title = wmn2 ? strdup(wmn2) : (wmn1 ? strdup(wmn1) : NULL);
         free(wmn1);
         free(wmn2);
@@ -254,6 +306,23 @@ int ewmh_initWinlist(void)
     return 1;
 }
 
+//
+// queue icons of all clients for warm-up
+//
+void ewmh_queueIconWarmup(void)
+{
+    Window *client_list;
+    unsigned long client_list_size;
+    int i;
+
+    client_list = ewmh_get_client_list(&client_list_size);
+    if (client_list == NULL)
+        return;
+    for (i = 0; i < client_list_size / sizeof(Window); i++)
+        queueIconWarmup(client_list[i]);
+    free(client_list);
+}
+
 //
 // focus window in EWMH WM
 // fwin used if non-zero, winNdx otherwise
@@ -276,7 +345,7 @@ int ewmh_setFocus(int winNdx, Window fwin)
     return 1;
 }
 
-static unsigned long ewmh_getDesktopFromProp(Window w, char *prop1, char *prop2)
+static unsigned long ewmh_getDesktopFromProp(Window w, Atom prop1, Atom prop2)
 {
     unsigned long *d;
     unsigned long propsize;
@@ -297,7 +366,8 @@ static unsigned long ewmh_getDesktopFromProp(Window w, char *prop1, char *prop2)
 //
 unsigned long ewmh_getCurrentDesktop(void)
 {
-    return ewmh_getDesktopFromProp(root, "_NET_CURRENT_DESKTOP", "_WIN_WORKSPACE");
+    return ewmh_getDesktopFromProp(root, g.atom[AT_NET_CURRENT_DESKTOP],
+                                   g.atom[AT_WIN_WORKSPACE]);
 }
 
 //
@@ -305,7 +375,8 @@ unsigned long ewmh_getCurrentDesktop(void)
 //
 unsigned long ewmh_getDesktopOfWindow(Window w)
 {
-    return ewmh_getDesktopFromProp(w, "_NET_WM_DESKTOP", "_WIN_WORKSPACE");
+    return ewmh_getDesktopFromProp(w, g.atom[AT_NET_WM_DESKTOP],
+                                   g.atom[AT_WIN_WORKSPACE]);
 }
 
 //
@@ -315,21 +386,20 @@ bool ewmh_skipWindowInTaskbar(Window w)
 {
     Atom *state;
     long unsigned int state_propsize;
-    Atom a_skip_tb;
     int i;
     bool ret = false;
 
     if (g.option_no_skip_taskbar)
         return false;
     state =
-        (Atom *) get_x_property(w, XA_ATOM, "_NET_WM_STATE", &state_propsize);
+        (Atom *) get_x_property(w, XA_ATOM, g.atom[AT_NET_WM_STATE],
+                                &state_propsize);
     if (state == NULL || state_propsize == 0) {
         msg(1, "%lx: no _NET_WM_STATE property\n", w);
         goto out;
     }
-    a_skip_tb = XInternAtom(dpy, "_NET_WM_STATE_SKIP_TASKBAR", True);
     for (i = 0; i < state_propsize / sizeof(Atom); i++) {
-        if (state[i] == a_skip_tb) {
+        if (state[i] == g.atom[AT_NET_WM_STATE_SKIP_TASKBAR]) {
             msg(1, "%lx: _NET_WM_STATE_SKIP_TASKBAR found\n", w);
             ret = true;
             goto out;
@@ -20,6 +20,7 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 
 #include <X11/Xlib.h>
 #include <X11/Xutil.h>
+#include <X11/Xatom.h>
 #include <X11/Xft/Xft.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -42,12 +43,29 @@ static int lastPressedTile;
 static quad scrdim;
 static Window uiwin;
 static int uiwinW, uiwinH, uiwinX, uiwinY;
+static quad uiwinAbs;           // actual geometry, kept by uiConfigureEvent
 static Colormap colormap;
 static Visual *visual;
 //Font fontLabel;  // Xft instead
 static XftFont *fontLabel;
 static int selNdx;                 // current (selected) item
 
+// tile of a window with everything it was drawn from,
+// kept across uiHide until one of these changes
+typedef struct TileCache {
+    Window id;                  // uthash key
+    Pixmap tile;
+    unsigned int tileW, tileH, iconW, iconH;
+    Pixmap icon_drawable, icon_mask;
+    unsigned int icon_w, icon_h;
+    char name[MAXNAMESZ];
+    char bottom_line[MAXNAMESZ];
+    bool gone;                  // outdated while on screen, free in uiHide
+    bool used;                  // by current uiShow, otherwise free in uiHide
+    UT_hash_handle hh;
+} TileCache;
+static TileCache *tiles = NULL;
+
 //
 // allocates GC
 // type is:
@@ -156,9 +174,9 @@ static int pointedTile(int x, int y)
 
 //
 // combine widgets into wi->tile
-// for uiShow()
+// for prepareTile()
 //
-static void prepareTile(WindowInfo * wi)
+static void drawTile(WindowInfo * wi)
 {
     XGlyphInfo ext;
     int bottW = 0, bottH = 0, bottX = 0, bottY = 0;
@@ -285,7 +303,72 @@ endBottomLine:
             msg(-1, "can't draw label\n");
         }
     }
-}                               // prepareTile
+}                               // drawTile
+
+//
+// was tile "t" drawn from the same data as needed for "wi" now?
+//
+static bool tileMatches(TileCache * t, WindowInfo * wi)
+{
+    return t->tileW == tileW && t->tileH == tileH
+        && t->iconW == iconW && t->iconH == iconH
+        && t->icon_drawable == wi->icon_drawable
+        && t->icon_mask == wi->icon_mask
+        && t->icon_w == wi->icon_w && t->icon_h == wi->icon_h
+        && strncmp(t->name, wi->name, MAXNAMESZ) == 0
+        && strncmp(t->bottom_line, wi->bottom_line, MAXNAMESZ) == 0;
+}
+
+//
+// free cached tile of the window
+//
+static void dropTile(TileCache * t)
+{
+    HASH_DEL(tiles, t);
+    if (t->tile)
+        XFreePixmap(dpy, t->tile);
+    free(t);
+}
+
+//
+// fill wi->tile for uiShow(),
+// reusing the tile from previous uiShow if nothing changed
+//
+static void prepareTile(WindowInfo * wi)
+{
+    TileCache *t;
+
+    HASH_FIND(hh, tiles, &(wi->id), sizeof(Window), t);
+    if (t != NULL && tileMatches(t, wi)) {
+        msg(1, "reusing tile of %lx\n", wi->id);
+        wi->tile = t->tile;
+        t->used = true;
+        return;
+    }
+    if (t == NULL) {
+        t = malloc(sizeof(TileCache));
+        if (t == NULL)
+            die("can't allocate tile cache");
+        t->id = wi->id;
+        t->gone = false;
+        HASH_ADD(hh, tiles, id, sizeof(Window), t);
+    } else if (t->tile) {
+        XFreePixmap(dpy, t->tile);
+    }
+    drawTile(wi);
+    t->used = true;
+    t->tile = wi->tile;
+    t->tileW = tileW;
+    t->tileH = tileH;
+    t->iconW = iconW;
+    t->iconH = iconH;
+    t->icon_drawable = wi->icon_drawable;
+    t->icon_mask = wi->icon_mask;
+    t->icon_w = wi->icon_w;
+    t->icon_h = wi->icon_h;
+    strncpy(t->name, wi->name, MAXNAMESZ);
+    strncpy(t->bottom_line, wi->bottom_line, MAXNAMESZ);
+}
 
 //
 // grab auxiliary keys: arrows, cancel, kill
@@ -607,6 +690,8 @@ int uiShow(bool direction)
     if (!g.winlist) {
         die("no winlist in uiShow. this shouldn't happen, please report.");
     }
+    if (iconW > 0 && iconH > 0)
+        fitWinlistIcons(iconW, iconH);
     int m;
     for (m = 0; m < g.maxNdx; m++) {
         prepareTile(&(g.winlist[m]));
@@ -636,22 +721,21 @@ int uiShow(bool direction)
 // warning: this overwrites any previous value.
 // note: x_setCommonPropertiesForAnyWindow does the same thing for any window
     XSelectInput(dpy, uiwin, ExposureMask | KeyPressMask | KeyReleaseMask
-                 | ButtonPressMask | ButtonReleaseMask);
+                 | ButtonPressMask | ButtonReleaseMask | StructureNotifyMask);
+    uiwinAbs.x = uiwinX + g.option_borderW;
+    uiwinAbs.y = uiwinY + g.option_borderW;
+    uiwinAbs.w = uiwinW;
+    uiwinAbs.h = uiwinH;
     grabKeysAtUiShow(true);
 // set window type so that WM will hopefully not resize it
 // before mapping: https://specifications.freedesktop.org/wm-spec/1.3/ar01s05.html
-    Atom at = XInternAtom(dpy, "ATOM", True);
-    Atom wt = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE", False);
-    Atom td = XInternAtom(dpy, "_NET_WM_WINDOW_TYPE_DIALOG", False);
-    if (at && wt && td)
-        XChangeProperty(dpy, uiwin, wt, at, 32, PropModeReplace,
-                        (unsigned char *)(&td), 1);
-// disable appearance in taskbar
-    Atom st = XInternAtom(dpy, "_NET_WM_STATE", True);
-    Atom sk = XInternAtom(dpy, "_NET_WM_STATE_SKIP_TASKBAR", True); // there is also PAGER
-    if (at && st && sk)
-        XChangeProperty(dpy, uiwin, st, at, 32, PropModeReplace,
-                        (unsigned char *)(&sk), 1);
+    XChangeProperty(dpy, uiwin, g.atom[AT_NET_WM_WINDOW_TYPE], XA_ATOM, 32,
+                    PropModeReplace,
+                    (unsigned char *)(&g.atom[AT_NET_WM_WINDOW_TYPE_DIALOG]), 1);
+// disable appearance in taskbar (there is also PAGER)
+    XChangeProperty(dpy, uiwin, g.atom[AT_NET_WM_STATE], XA_ATOM, 32,
+                    PropModeReplace,
+                    (unsigned char *)(&g.atom[AT_NET_WM_STATE_SKIP_TASKBAR]), 1);
 // xmonad ignores _NET_WM_WINDOW_TYPE_DIALOG but obeys WM_TRANSIENT_FOR
     XSetTransientForHint(dpy, uiwin, uiwin);
 // disable window title and borders. works in xfwm4.
@@ -665,11 +749,9 @@ int uiShow(bool direction)
         unsigned long status;
     } hints = {
     MWM_HINTS_DECORATIONS, 0, 0,};
-    Atom ma = XInternAtom(dpy, "_MOTIF_WM_HINTS", False);
-    if (ma) {
-        XChangeProperty(dpy, uiwin, ma, ma, 32, PropModeReplace,
-                        (unsigned char *)&hints, PROP_MOTIF_WM_HINTS_ELEMENTS);
-    }
+    XChangeProperty(dpy, uiwin, g.atom[AT_MOTIF_WM_HINTS],
+                    g.atom[AT_MOTIF_WM_HINTS], 32, PropModeReplace,
+                    (unsigned char *)&hints, PROP_MOTIF_WM_HINTS_ELEMENTS);
 
     XMapWindow(dpy, uiwin);
 
@@ -713,25 +795,23 @@ void uiExpose(void)
 // if WM moved uiwin, here is the place
 // where we first see 'bad' absolute coordinates.
 // try to correct them.
-    quad uwq;
-    if (get_absolute_coordinates(uiwin, &uwq)) {
+    quad uwq = uiwinAbs;
 // debug for #54
-        msg(1, "attr abs at expose: %dx%d +%d+%d\n",
-            uwq.w, uwq.h, uwq.x, uwq.y);
-        int xdiff = uwq.x - uiwinX;
-        int ydiff = uwq.y - uiwinY;
-        if (abs(xdiff) > FRAME_W / 2 || abs(ydiff) > FRAME_W / 2) {
-            msg(1, "WM moved uiwin too far, trying to correct\n");
-            XMoveWindow(dpy, uiwin, uiwinX, uiwinY);
-        }
-        if (uwq.w != uiwinW || uwq.h != uiwinH) {
-            // WM resized our window, like
-            // floating_maximum_size in #54.
-            // there is little can be done here,
-            // so just complain.
-            msg(-1,
-                "switcher window resized, expect bugs. Please configure WM to not interfere with alttab window size, for example, disable 'floating_maximum_size' in i3\n");
-        }
+    msg(1, "attr abs at expose: %dx%d +%d+%d\n",
+        uwq.w, uwq.h, uwq.x, uwq.y);
+    int xdiff = uwq.x - uiwinX;
+    int ydiff = uwq.y - uiwinY;
+    if (abs(xdiff) > FRAME_W / 2 || abs(ydiff) > FRAME_W / 2) {
+        msg(1, "WM moved uiwin too far, trying to correct\n");
+        XMoveWindow(dpy, uiwin, uiwinX, uiwinY);
+    }
+    if (uwq.w != uiwinW || uwq.h != uiwinH) {
+        // WM resized our window, like
+        // floating_maximum_size in #54.
+        // there is little can be done here,
+        // so just complain.
+        msg(-1,
+            "switcher window resized, expect bugs. Please configure WM to not interfere with alttab window size, for example, disable 'floating_maximum_size' in i3\n");
     }
 // icons
     int j;
@@ -742,6 +822,24 @@ void uiExpose(void)
     framesRedraw();
 }
 
+//
+// forget tile of destroyed window or of changed icon,
+// which may be the same pixmap id with new content.
+// if the tile is on screen now, it's freed in uiHide.
+//
+void uiForgetTile(Window w)
+{
+    TileCache *t;
+
+    HASH_FIND(hh, tiles, &w, sizeof(Window), t);
+    if (t == NULL)
+        return;
+    if (g.uiShowHasRun)
+        t->gone = true;
+    else
+        dropTile(t);
+}
+
 //
 // remove ui and switch to chosen window
 //
@@ -767,13 +865,15 @@ int uiHide(void)
          */
         setFocus(selNdx);     // before winlist destruction!
     }
-    msg(0, "destroying tiles\n");
-    int y;
-    for (y = 0; y < g.maxNdx; y++) {
-        if (g.winlist && g.winlist[y].tile) {
-            XFreePixmap(dpy, g.winlist[y].tile);
-            g.winlist[y].tile = 0;
-        }
+    // tiles are kept for next uiShow,
+    // except of ones forgotten meanwhile
+    // and of windows which weren't in this winlist
+    TileCache *t, *tmp;
+    HASH_ITER(hh, tiles, t, tmp) {
+        if (t->gone || !t->used)
+            dropTile(t);
+        else
+            t->used = false;
     }
     if (g.winlist) {
         freeWinlist();
@@ -831,6 +931,11 @@ int uiKillWindow(void)
         return 0;
     }
     msg(1, "blanking tile %d\n", selNdx);
+    // don't reuse blank tile if the window survives
+    TileCache *t;
+    HASH_FIND(hh, tiles, &w, sizeof(Window), t);
+    if (t != NULL)
+        t->tileW = 0;
     if (! XFillRectangle(dpy, wi.tile, g.gcReverse, 0, 0,
                             tileW, tileH)) {
         msg(-1, "can't fill tile\n");
@@ -859,6 +964,21 @@ int uiSelectWindow(int ndx)
     return 1;
 }
 
+//
+// ConfigureNotify of our window: WM may move or resize it.
+// it is override-redirect child of root,
+// so coordinates are relative to root
+//
+void uiConfigureEvent(XConfigureEvent e)
+{
+    if (e.window != uiwin)
+        return;
+    uiwinAbs.x = e.x + e.border_width;
+    uiwinAbs.y = e.y + e.border_width;
+    uiwinAbs.w = e.width;
+    uiwinAbs.h = e.height;
+}
+
 //
 // mouse press/release handler
 //
@@ -909,6 +1029,11 @@ void shutdownGUI(void)
 
     //XftFontClose(dpy, fontLabel); // actually, not needed
 
+    TileCache *t, *tmp;
+    HASH_ITER(hh, tiles, t, tmp) {
+        dropTile(t);
+    }
+
     if (g.gcDirect)
         XFreeGC(dpy, g.gcDirect);
     if (g.gcReverse)
@@ -20,6 +20,10 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 
 #define _GNU_SOURCE
 #include <string.h>
+#include <pthread.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/syscall.h>
 //#include "util.h"
 #include "alttab.h"
 #include "pngd.h"
@@ -29,8 +33,489 @@ extern Display *dpy;
 extern int scr;
 extern Window root;
 
+// PRIVATE
+
+#if defined(__linux__) && defined(SYS_getdents64)
+#define ICONSCAN_DENTS
+#endif
+
+#ifdef ICONSCAN_DENTS
+#define ICONSCAN_MAXDEPTH   8
+#define ICONSCAN_BUFSIZE    32768
+
+struct icondirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+#endif
+
+// icon hash built in background, see startIconHash.
+// the builder thread doesn't touch X, so Xlib needs no locking.
+static pthread_t ihash_thread;
+static bool ihash_running = false;  // used by main thread only
+static pthread_mutex_t ihash_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool ihash_done = false;     // under ihash_lock
+static icon_t *ihash_bg = NULL;     // under ihash_lock
+
+static int scanIconHash(icon_t ** ihash);
+
+//
+// thread building icon hash off the main loop.
+// rescan != NULL: don't trust the index, see rescanIconHash
+//
+static void *iconHashBuilder(void *rescan)
+{
+    icon_t *ih;
+
+    if (rescan != NULL) {
+        ih = NULL;              // required by uthash
+        scanIconHash(&ih);
+    } else {
+        initIconHash(&ih);
+    }
+    pthread_mutex_lock(&ihash_lock);
+    ihash_bg = ih;
+    ihash_done = true;
+    pthread_mutex_unlock(&ihash_lock);
+    return NULL;
+}
+
+// interned strings of icon hashes: app names, directories, file names.
+// shared by scan threads, so locked.
+// nothing is freed before freeIconStrings.
+#define ICONSTR_CHUNK   65536
+static pthread_mutex_t istr_lock = PTHREAD_MUTEX_INITIALIZER;
+static iconstrchunk_t *istr_arena = NULL;
+static iconstr_t *istr_index = NULL;
+
+//
+// allocate from arena, under istr_lock
+//
+static void *iconStrAlloc(size_t size)
+{
+    iconstrchunk_t *c;
+    void *p;
+    size_t cs;
+
+    size = (size + 7) & ~((size_t) 7);
+    if (istr_arena == NULL || istr_arena->used + size > istr_arena->size) {
+        cs = size > ICONSTR_CHUNK ? size : ICONSTR_CHUNK;
+        c = malloc(sizeof(iconstrchunk_t) + cs);
+        if (c == NULL)
+            return NULL;
+        c->next = istr_arena;
+        c->used = 0;
+        c->size = cs;
+        istr_arena = c;
+    }
+    p = istr_arena->data + istr_arena->used;
+    istr_arena->used += size;
+    return p;
+}
+
+// flat lookup table over g.ic: open addressing, linear probing.
+// stored hashes skip almost all string compares,
+// and the probe lowercases on the fly instead of copying.
+// there is no incremental update: every itab_gen bump
+// (each inotify batch in processIconWatch, each hash swap in pollIconHash)
+// makes the next lookupIcon rebuild the whole table, O(apps).
+// rebuild is lazy, so any number of batches between two uiShow
+// cost one rebuild. test/iconlookup measures it.
+static iconslot_t *itab = NULL;
+static uint32_t itab_mask = 0;
+static icon_t *itab_src = NULL;     // g.ic the table was built for
+static bool itab_stale = true;
+static unsigned int itab_gen = 0;   // bumped on every g.ic change
+
+//
+// FNV-1a of lowercased name, as many chars as inspectIconMeta keeps.
+// *len is set to the number of chars hashed
+//
+static uint32_t iconNameHash(const char *s, int *len)
+{
+    uint32_t h = 2166136261u;
+    int l;
+
+    for (l = 0; s[l] != '\0' && l < MAXAPPLEN - 1; l++) {
+        h ^= (unsigned char)tolower((unsigned char)s[l]);
+        h *= 16777619u;
+    }
+    *len = l;
+    return h ? h : 1;
+}
+
+//
+// (re)build lookup table for ihash
+// 1=success
+//
+static int buildIconTable(icon_t * ihash)
+{
+    icon_t *ic, *tmp;
+    uint32_t size, h, i;
+    int l;
+
+    size = 16;
+    while (size < HASH_COUNT(ihash) * 2)
+        size <<= 1;
+    free(itab);
+    itab = calloc(size, sizeof(iconslot_t));
+    itab_src = ihash;
+    itab_stale = false;
+    if (itab == NULL) {
+        itab_mask = 0;
+        return 0;
+    }
+    itab_mask = size - 1;
+    HASH_ITER(hh, ihash, ic, tmp) {
+        h = iconNameHash(ic->app, &l);
+        for (i = h & itab_mask; itab[i].hash != 0; i = (i + 1) & itab_mask) ;
+        itab[i].hash = h;
+        itab[i].ic = ic;
+    }
+    msg(1, "icon lookup table: %u slots for %u apps\n", size,
+        HASH_COUNT(ihash));
+    return 1;
+}
+
+//
+// check if new height better matches target height,
+// see iconMatchBetter
+//
+static bool matchBetter(int target, int new_h, int old_h,
+                        bool equal_prefer_new)
+{
+    int hasdiff, newdiff;
+
+    hasdiff = old_h - target;
+    newdiff = new_h - target;
+    if (hasdiff == newdiff && equal_prefer_new)
+        return true;
+    return
+        (hasdiff >= 0) ? ((newdiff < 0) ? false : ((newdiff <
+                                                    hasdiff) ? true : false)
+        ) : ((newdiff >= 0) ? true : ((newdiff > hasdiff) ? true : false)
+        );
+}
+
+//
+// record file of already interned dir/name as one of icon sizes.
+// the first file of given size is kept, like in inspectIconMeta.
+// return 1 if recorded or updated, 0 otherwise
+//
+static int addSizeEntry(icon_t * ic, const iconsize_t * is)
+{
+    iconsize_t *ns;
+    int i;
+
+    for (i = 0; i < ic->nsizes; i++) {
+        if (ic->sizes[i].src_dir == is->src_dir
+            && ic->sizes[i].src_name == is->src_name) {
+            ic->sizes[i] = *is;     // rewritten
+            return 1;
+        }
+    }
+    for (i = 0; i < ic->nsizes; i++) {
+        if (ic->sizes[i].src_w == is->src_w
+            && ic->sizes[i].src_h == is->src_h)
+            return 0;
+    }
+    if (ic->nsizes == ic->sizes_alloc) {
+        ns = realloc(ic->sizes, (ic->sizes_alloc + 4) * sizeof(iconsize_t));
+        if (ns == NULL)
+            return 0;
+        ic->sizes = ns;
+        ic->sizes_alloc += 4;
+    }
+    ic->sizes[ic->nsizes++] = *is;
+    return 1;
+}
+
+//
+// file of the icon closest to height h, or NULL
+//
+static iconsize_t *closestIconSize(icon_t * ic, unsigned int h)
+{
+    iconsize_t *best = NULL;
+    int i;
+
+    for (i = 0; i < ic->nsizes; i++) {
+        if (best == NULL || matchBetter(h, ic->sizes[i].src_h,
+                                        best->src_h, false))
+            best = &(ic->sizes[i]);
+    }
+    return best;
+}
+
+//
+// is the file path, or below path if dir?
+//
+static bool sizeFromPath(const iconsize_t * is, const char *path, bool dir)
+{
+    size_t plen = strlen(path);
+    const char *sl = strrchr(path, '/');
+
+    if (dir)
+        return strncmp(is->src_dir, path, plen) == 0
+            && (is->src_dir[plen] == '/' || is->src_dir[plen] == '\0');
+    return sl != NULL && strncmp(is->src_dir, path, sl - path) == 0
+        && is->src_dir[sl - path] == '\0'
+        && strcmp(is->src_name, sl + 1) == 0;
+}
+
+//
+// scan icon dirs into empty hash and refresh the user's index
+// 1=success
+//
+static int scanIconHash(icon_t ** ihash)
+{
+    char path[MAXICONPATHLEN];
+    icondirlist_t dl = { NULL, 0, 0 };
+
+    updateIconsFromFile(ihash, &dl);
+    if (iconIndexPath(path, sizeof(path), false))
+        saveIconIndex(*ihash, &dl, path);
+    freeIconDirList(&dl);
+    return 1;
+}
+
+//
+// free lists filled by readIconTheme
+//
+static void freeIconTheme(icontheme_t * th)
+{
+    char **l;
+
+    for (l = th->dirs; l != NULL && *l != NULL; l++)
+        free(*l);
+    for (l = th->inherits; l != NULL && *l != NULL; l++)
+        free(*l);
+    free(th->dirs);
+    free(th->inherits);
+    th->dirs = th->inherits = NULL;
+}
+
+//
+// append copy of first len chars of s to NULL-terminated list of n
+// 1=success
+//
+static int themeListAdd(char ***list, int *n, const char *s, size_t len)
+{
+    char **nl;
+
+    nl = realloc(*list, (*n + 2) * sizeof(char *));
+    if (nl == NULL)
+        return 0;
+    *list = nl;
+    nl[*n] = strndup(s, len);
+    if (nl[*n] == NULL)
+        return 0;
+    nl[++(*n)] = NULL;
+    return 1;
+}
+
+//
+// is name in comma-separated list from index.theme?
+//
+static bool themeListHas(const char *list, const char *name)
+{
+    size_t nlen = strlen(name);
+    const char *c;
+
+    for (c = list; c != NULL; c = strchr(c, ',')) {
+        if (*c == ',')
+            c++;
+        while (*c == ' ')
+            c++;
+        if (strncmp(c, name, nlen) == 0
+            && (c[nlen] == ',' || c[nlen] == ' ' || c[nlen] == '\0'))
+            return true;
+    }
+    return false;
+}
+
+//
+// theme of icon root: its last path component,
+// NULL for legacy pixmap dirs
+//
+static const char *iconRootTheme(const char *dir)
+{
+    const char *sl;
+
+    if (strstr(dir, "pixmap") != NULL)
+        return NULL;
+    sl = strrchr(dir, '/');
+    return sl ? sl + 1 : dir;
+}
+
+//
+// read index.theme from the first root of theme in icon_dirs having it,
+// as freedesktop icon theme spec says.
+// th->dirs gets subdirectories from Directories= with fixed size
+// application icons, th->inherits gets Inherits=.
+// 1=index.theme found
+//
+static int readIconTheme(char **icon_dirs, const char *theme,
+                         icontheme_t * th)
+{
+    char path[MAXICONPATHLEN];
+    FILE *f = NULL;
+    char *line = NULL, *l, *e, *v, *sp;
+    size_t lsize = 0;
+    char *sect = NULL, *dirlist = NULL;
+    char **cand = NULL;         // app sections, maybe not in Directories=
+    int ncand = 0, ndirs = 0, ninh = 0, i;
+    bool apps = false, usable = true;
+    const char *rt;
+
+    th->dirs = th->inherits = NULL;
+    for (i = 0; icon_dirs[i] != NULL && f == NULL; i++) {
+        rt = iconRootTheme(icon_dirs[i]);
+        if (rt == NULL || strcmp(rt, theme) != 0)
+            continue;
+        snprintf(path, sizeof(path), "%s/index.theme", icon_dirs[i]);
+        f = fopen(path, "r");
+    }
+    if (f == NULL)
+        return 0;
+    msg(1, "reading %s\n", path);
+
+    // the last pass with l=NULL closes the last section
+    do {
+        l = (getline(&line, &lsize, f) == -1) ? NULL : line;
+        if (l != NULL) {
+            while (*l == ' ' || *l == '\t')
+                l++;
+            for (e = l + strlen(l); e > l && isspace((unsigned char)e[-1]); e--)
+                e[-1] = '\0';
+        }
+        if (l == NULL || *l == '[') {
+            if (sect != NULL && apps && usable)
+                themeListAdd(&cand, &ncand, sect, strlen(sect));
+            free(sect);
+            sect = NULL;
+            if (l == NULL || (e = strchr(l, ']')) == NULL)
+                continue;
+            sect = strndup(l + 1, e - l - 1);
+            // Context= decides, if present
+            v = sect ? strrchr(sect, '/') : NULL;
+            apps = sect && strcmp(v ? v + 1 : sect, "apps") == 0;
+            usable = true;
+            continue;
+        }
+        if (sect == NULL || *l == '#' || (v = strchr(l, '=')) == NULL)
+            continue;
+        for (e = v; e > l && e[-1] == ' '; e--) ;
+        *e = '\0';
+        for (v++; *v == ' '; v++) ;
+        if (strcmp(sect, "Icon Theme") == 0) {
+            if (strcmp(l, "Directories") == 0) {
+                free(dirlist);
+                dirlist = strdup(v);
+            } else if (strcmp(l, "Inherits") == 0) {
+                for (e = strtok_r(v, ", ", &sp); e != NULL;
+                     e = strtok_r(NULL, ", ", &sp))
+                    themeListAdd(&(th->inherits), &ninh, e, strlen(e));
+            }
+        } else if (strcmp(l, "Context") == 0) {
+            apps = (strcasecmp(v, "Applications") == 0
+                    || strcasecmp(v, "Apps") == 0);
+        } else if (strcmp(l, "Type") == 0) {
+            // svg only, which we can't load
+            if (strcasecmp(v, "Scalable") == 0)
+                usable = false;
+        } else if (strcmp(l, "Scale") == 0) {
+            // the same icons for HiDPI
+            if (atoi(v) > 1)
+                usable = false;
+        }
+    } while (l != NULL);
+    fclose(f);
+    free(line);
+
+    // dirs of the theme are those listed in Directories=
+    th->dirs = calloc(1, sizeof(char *));
+    for (i = 0; i < ncand; i++) {
+        if (th->dirs != NULL && dirlist != NULL
+            && themeListHas(dirlist, cand[i]))
+            themeListAdd(&(th->dirs), &ndirs, cand[i], strlen(cand[i]));
+        free(cand[i]);
+    }
+    free(cand);
+    free(dirlist);
+    if (th->dirs == NULL) {
+        freeIconTheme(th);
+        return 0;
+    }
+    msg(1, "icon theme %s: %d app dirs, %d inherited themes\n", theme,
+        ndirs, ninh);
+    return 1;
+}
+
+//
+// add theme to inheritance chain of allocIconDirs, once
+//
+static void addThemeToChain(char **chain, int *nchain, const char *theme)
+{
+    int c;
+
+    for (c = 0; c < *nchain; c++) {
+        if (strcmp(chain[c], theme) == 0)
+            return;
+    }
+    if (*nchain == MAXICONTHEMES || strchr(theme, '/') != NULL)
+        return;
+    if ((chain[*nchain] = strdup(theme)) != NULL)
+        (*nchain)++;
+}
+
 // PUBLIC:
 
+//
+// return the single copy of first len chars of s
+// or NULL if out of memory
+//
+const char *iconIntern(const char *s, size_t len)
+{
+    iconstr_t *is;
+    char *ns;
+
+    pthread_mutex_lock(&istr_lock);
+    HASH_FIND(hh, istr_index, s, len, is);
+    if (is == NULL) {
+        is = iconStrAlloc(sizeof(iconstr_t));
+        ns = iconStrAlloc(len + 1);
+        if (is == NULL || ns == NULL) {
+            pthread_mutex_unlock(&istr_lock);
+            return NULL;
+        }
+        memcpy(ns, s, len);
+        ns[len] = '\0';
+        is->s = ns;
+        HASH_ADD_KEYPTR(hh, istr_index, ns, len, is);
+    }
+    pthread_mutex_unlock(&istr_lock);
+    return is->s;
+}
+
+//
+// free interned strings, when no icon hash is left
+//
+void freeIconStrings(void)
+{
+    iconstrchunk_t *c;
+
+    pthread_mutex_lock(&istr_lock);
+    HASH_CLEAR(hh, istr_index);
+    while ((c = istr_arena) != NULL) {
+        istr_arena = c->next;
+        free(c);
+    }
+    pthread_mutex_unlock(&istr_lock);
+}
+
 //
 // icon constructor: safe defaults
 //
@@ -42,13 +527,16 @@ icon_t *initIcon(void)
     if (ic == NULL)
         return NULL;
 
-    ic->app[0] = '\0';
-    ic->src_path[0] = '\0';
+    ic->app = "";
+    ic->src_dir = ic->src_name = NULL;
     ic->src_w = ic->src_h = 0;
     ic->drawable = ic->mask = None;
     ic->drawable_allocated = false;
     ic->ext = ICON_EXT_UNKNOWN;
     ic->dir = ICON_DIR_FREEDESKTOP;
+    ic->sizes = NULL;
+    ic->nsizes = ic->sizes_alloc = 0;
+    ic->drawable_w = ic->drawable_h = 0;
 
     return ic;
 }
@@ -66,22 +554,109 @@ void deleteIcon(icon_t * ic)
         }
         */
     }
+    free(ic->sizes);
     free(ic);
 }
 
 //
 // hash constructor
+// try the icon index (user's, then system-wide) first,
+// scan icon directories and refresh the user's index otherwise
 // 1=success
 //
 int initIconHash(icon_t ** ihash)
 {
+    char path[MAXICONPATHLEN];
+
     *ihash = NULL;              // required by uthash
-    updateIconsFromFile(ihash);
+    if (iconIndexPath(path, sizeof(path), false)
+        && loadIconIndex(ihash, path))
+        return 1;
+    if (iconIndexPath(path, sizeof(path), true)
+        && loadIconIndex(ihash, path))
+        return 1;
+    return scanIconHash(ihash);
+}
+
+//
+// start building the icon hash in background
+// and watching icon dirs for changes.
+// until pollIconHash installs it, g.ic is empty,
+// so icons come from window properties, hints or placeholders.
+// 1=thread started, 0=hash is built synchronously instead
+//
+int startIconHash(void)
+{
+    g.ic = NULL;
+    // changes made during the scan are queued too
+    initIconWatch();
+    if (pthread_create(&ihash_thread, NULL, iconHashBuilder, NULL) != 0) {
+        msg(-1, "can't start icon scan thread, scanning synchronously\n");
+        initIconHash(&(g.ic));
+        return 0;
+    }
+    ihash_running = true;
     return 1;
 }
 
 //
-// build array of icon directories
+// scan icon dirs again in background, ignoring the index,
+// when changes of icon dirs were lost (inotify queue overflow).
+// g.ic is used until pollIconHash replaces it.
+// 1=thread started
+//
+int rescanIconHash(void)
+{
+    static bool rescan = true;
+
+    if (ihash_running)
+        return 1;
+    pthread_mutex_lock(&ihash_lock);
+    ihash_done = false;
+    pthread_mutex_unlock(&ihash_lock);
+    if (pthread_create(&ihash_thread, NULL, iconHashBuilder, &rescan) != 0) {
+        msg(-1, "can't start icon scan thread\n");
+        return 0;
+    }
+    ihash_running = true;
+    return 1;
+}
+
+//
+// install the hash built by startIconHash or rescanIconHash into g.ic,
+// if it's ready, and free the previous one.
+// wait=true blocks until the builder finishes.
+// must be called from main thread, outside of uiShow/uiHide,
+// then the switch is atomic for everything using g.ic.
+// return true if g.ic is complete
+//
+bool pollIconHash(bool wait)
+{
+    bool done;
+    icon_t *old;
+
+    if (!ihash_running)
+        return true;
+    pthread_mutex_lock(&ihash_lock);
+    done = ihash_done;
+    pthread_mutex_unlock(&ihash_lock);
+    if (!done && !wait)
+        return false;
+    pthread_join(ihash_thread, NULL);
+    ihash_running = false;
+    old = g.ic;
+    g.ic = ihash_bg;
+    ihash_bg = NULL;
+    deleteIconHash(&old);
+    invalidateIconTable();
+    msg(0, "icon hash is ready: %d apps\n", HASH_COUNT(g.ic));
+    return true;
+}
+
+//
+// build array of icon directories:
+// option_theme in base dirs, legacy pixmap dirs,
+// then themes it inherits (see index.theme) in the same base dirs
 // return the number of elements or 0
 //
 int allocIconDirs(char ** icon_dirs)
@@ -101,7 +676,8 @@ int allocIconDirs(char ** icon_dirs)
     int idndx = 0;
     int theme_len = strlen(g.option_theme);
     char *home = getenv("HOME");
-    char *xdgdd = getenv("XDG_DATA_DIRS");
+    char *xdgenv = getenv("XDG_DATA_DIRS");
+    char *xdgdd;
     bool legacy;
     char *str1;
     char *xdg;
@@ -109,6 +685,10 @@ int allocIconDirs(char ** icon_dirs)
     int j;
     char *k;
     int idsd;
+    char *chain[MAXICONTHEMES];
+    int nchain, nprimary, c;
+    icontheme_t th;
+    char **inh;
 
     for (hd = 0; icondir[hd] != NULL; hd++) {
         legacy = (strstr (icondir[hd], "pixmap") != NULL);
@@ -136,6 +716,8 @@ int allocIconDirs(char ** icon_dirs)
         idndx++;
     }
 
+    // strtok_r would spoil the environment for the next call
+    xdgdd = (xdgenv != NULL) ? strdup(xdgenv) : NULL;
     if (xdgdd != NULL) {
         for (j = 1, str1 = xdgdd; ; j++, str1 = NULL) {
             xdg = strtok_r(str1, ":", &saveptr1);
@@ -148,8 +730,10 @@ int allocIconDirs(char ** icon_dirs)
             }
             id2len = strlen(xdg) + strlen("/icons/") + theme_len + 1;
             id2 = malloc(id2len);
-            if (!id2)
+            if (!id2) {
+                free(xdgdd);
                 return 0;
+            }
             snprintf(id2, id2len, "%s/icons/%s", xdg, g.option_theme);
             id2[id2len - 1] = '\0';
             // search for duplicates
@@ -165,9 +749,50 @@ int allocIconDirs(char ** icon_dirs)
                 idndx++;
             }
         }
+        free(xdgdd);
     }
 
     icon_dirs[idndx] = NULL;
+
+    // then themes inherited by option_theme, and hicolor at last,
+    // in the same base dirs
+    nprimary = idndx;
+    chain[0] = g.option_theme;
+    nchain = 1;
+    for (c = 0; c < nchain; c++) {
+        for (j = 0; c > 0 && j < nprimary && idndx < MAXICONDIRS - 1; j++) {
+            if (iconRootTheme(icon_dirs[j]) == NULL)
+                continue;
+            id2len = strlen(icon_dirs[j]) - theme_len + strlen(chain[c]) + 1;
+            id2 = malloc(id2len);
+            if (!id2)
+                break;
+            snprintf(id2, id2len, "%.*s%s",
+                     (int)(strlen(icon_dirs[j]) - theme_len), icon_dirs[j],
+                     chain[c]);
+            for (idsd = 0; idsd < idndx; idsd++) {
+                if (strcmp(icon_dirs[idsd], id2) == 0) {
+                    free(id2);
+                    id2 = NULL;
+                    break;
+                }
+            }
+            if (id2 != NULL) {
+                icon_dirs[idndx++] = id2;
+                icon_dirs[idndx] = NULL;
+            }
+        }
+        if (readIconTheme(icon_dirs, chain[c], &th)) {
+            for (inh = th.inherits; inh != NULL && *inh != NULL; inh++)
+                addThemeToChain(chain, &nchain, *inh);
+            freeIconTheme(&th);
+        }
+        if (c == nchain - 1)
+            addThemeToChain(chain, &nchain, "hicolor");
+    }
+    for (c = 1; c < nchain; c++)
+        free(chain[c]);
+
     if (g.debug > 1) {
         for (idndx = 0; icon_dirs[idndx] != NULL; idndx++)
             msg(1, "icon dir: %s\n", icon_dirs[idndx]);
@@ -186,73 +811,478 @@ void destroyIconDirs(char ** icon_dirs)
 }
 
 //
-// load all icons
-// (no pixmaps, just path and dimension)
+// remember directory visited by scan
+// 1=success
 //
-int updateIconsFromFile(icon_t ** ihash)
+static int appendIconDir(icondirlist_t * dl, const char *path,
+                         struct timespec *mtime, bool root)
 {
-    char *icon_dirs[MAXICONDIRS];
-    int d_c, f_c;
+    icondir_t *nd;
+
+    if (dl->n == dl->size) {
+        dl->size = dl->size ? dl->size * 2 : 64;
+        nd = realloc(dl->d, dl->size * sizeof(icondir_t));
+        if (nd == NULL)
+            return 0;
+        dl->d = nd;
+    }
+    nd = &(dl->d[dl->n]);
+    nd->path = strdup(path);
+    if (nd->path == NULL)
+        return 0;
+    nd->mtime = *mtime;
+    nd->root = root;
+    dl->n++;
+    return 1;
+}
+
+//
+// free directory list filled by updateIconsFromFile
+//
+void freeIconDirList(icondirlist_t * dl)
+{
+    int i;
+
+    for (i = 0; i < dl->n; i++)
+        free(dl->d[i].path);
+    free(dl->d);
+    dl->d = NULL;
+    dl->n = dl->size = 0;
+}
+
+//
+// remember directory, if it exists and isn't remembered yet
+// return true if it exists
+//
+static bool recordIconDir(iconscan_t * sc, const char *path, bool root)
+{
+    struct stat st;
+    int i;
+
+    if (stat(path, &st) == -1 || !S_ISDIR(st.st_mode))
+        return false;
+    for (i = sc->dl.n - 1; i >= 0; i--) {
+        if (strcmp(sc->dl.d[i].path, path) == 0)
+            return true;
+    }
+    if (!appendIconDir(&(sc->dl), path, &(st.st_mtim), root))
+        msg(-1, "can't remember icon dir %s\n", path);
+    return true;
+}
+
+//
+// read icons of a directory listed in index.theme,
+// without recursion and stat of every file
+//
+static void scanIconSubdir(iconscan_t * sc, const char *sub)
+{
+    char path[MAXICONPATHLEN];
+    char fpath[MAXICONPATHLEN];
+    DIR *d;
+    struct dirent *de;
+    char *sl;
+
+    if (snprintf(path, sizeof(path), "%s/%s", sc->dir, sub) >= sizeof(path))
+        return;
+    // all directories down to sub, so that creating
+    // any of them makes the index outdated
+    if (sc->record_dirs) {
+        for (sl = strchr(path + strlen(sc->dir) + 1, '/'); sl != NULL;
+             sl = strchr(sl + 1, '/')) {
+            *sl = '\0';
+            if (!recordIconDir(sc, path, false))
+                return;
+            *sl = '/';
+        }
+        if (!recordIconDir(sc, path, false))
+            return;
+    }
+    if ((d = opendir(path)) == NULL)
+        return;
+    sc->d_c++;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.' || de->d_type == DT_DIR)
+            continue;
+        snprintf(fpath, sizeof(fpath), "%s/%s", path, de->d_name);
+        inspectIconPath(&(sc->ic), fpath, NULL);
+        sc->f_c++;
+    }
+    closedir(d);
+}
+
+#ifdef ICONSCAN_DENTS
+//
+// walk directory fd, which is path, recursively in the same order
+// and with the same result as fts with FTS_LOGICAL.
+// only symlinks and DT_UNKNOWN entries are stat'ed, files otherwise not.
+// st is of the directory; adev/aino hold its ancestors to break symlink loops.
+//
+static void walkIconDir(iconscan_t * sc, int fd, char *path,
+                        struct stat *st, int depth, dev_t * adev,
+                        ino_t * aino)
+{
+    char *buf;
+    long n, off;
+    struct icondirent64 *de;
+    size_t plen = strlen(path);
+    struct stat cst;
+    bool isdir;
+    int cfd, a;
+
+    if (sc->record_dirs
+        && !appendIconDir(&(sc->dl), path, &(st->st_mtim), depth == 0))
+        msg(-1, "can't remember icon dir %s\n", path);
+    sc->d_c++;
+    adev[depth] = st->st_dev;
+    aino[depth] = st->st_ino;
+    if ((buf = malloc(ICONSCAN_BUFSIZE)) == NULL)
+        return;
+    while ((n = syscall(SYS_getdents64, fd, buf, ICONSCAN_BUFSIZE)) > 0) {
+        for (off = 0; off < n; off += de->d_reclen) {
+            de = (struct icondirent64 *)(buf + off);
+            if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0)
+                continue;
+            if (plen + 1 + strlen(de->d_name) >= MAXICONPATHLEN)
+                continue;
+            if (de->d_type == DT_LNK || de->d_type == DT_UNKNOWN) {
+                if (fstatat(fd, de->d_name, &cst, 0) == -1)
+                    continue;   // dangling
+                isdir = S_ISDIR(cst.st_mode);
+                if (!isdir && !S_ISREG(cst.st_mode))
+                    continue;
+            } else {
+                isdir = (de->d_type == DT_DIR);
+                if (!isdir && de->d_type != DT_REG)
+                    continue;
+            }
+            path[plen] = '/';
+            strcpy(path + plen + 1, de->d_name);
+            if (!isdir) {
+                inspectIconPath(&(sc->ic), path, NULL);
+                sc->f_c++;
+            } else if (depth + 1 < ICONSCAN_MAXDEPTH
+                       && (cfd = openat(fd, de->d_name,
+                                        O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+                if (fstat(cfd, &cst) == 0) {
+                    for (a = 0; a <= depth; a++) {
+                        if (adev[a] == cst.st_dev && aino[a] == cst.st_ino)
+                            break;
+                    }
+                    if (a > depth)
+                        walkIconDir(sc, cfd, path, &cst, depth + 1, adev, aino);
+                }
+                close(cfd);
+            }
+            path[plen] = '\0';
+        }
+    }
+    free(buf);
+}
+
+//
+// walk the whole root with walkIconDir
+// 1=success
+//
+static int scanIconRootDents(iconscan_t * sc)
+{
+    char path[MAXICONPATHLEN];
+    dev_t adev[ICONSCAN_MAXDEPTH];
+    ino_t aino[ICONSCAN_MAXDEPTH];
+    struct stat st;
+    int fd;
+
+    fd = open(sc->dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0)
+        return 1;               // no files to traverse
+    strncpy(path, sc->dir, MAXICONPATHLEN - 1);
+    path[MAXICONPATHLEN - 1] = '\0';
+    if (fstat(fd, &st) == 0)
+        walkIconDir(sc, fd, path, &st, 0, adev, aino);
+    close(fd);
+    return 1;
+}
+#else
+//
+// walk whole tree at sc->dir with fts, which stats every entry
+// 1=success
+//
+static int scanIconRootFts(iconscan_t * sc)
+{
+    char *roots[2] = { sc->dir, NULL };
     FTS *ftsp;
     FTSENT *p, *chp;
-    icon_t *iiter, *tmp;
     int fts_options = FTS_COMFOLLOW | FTS_LOGICAL | FTS_NOCHDIR;
-    int ret = 0;
 
-    if (allocIconDirs(icon_dirs) <= 0) {
-        goto out;
-    }
-    if ((ftsp = fts_open(icon_dirs, fts_options, NULL)) == NULL) {
+    if ((ftsp = fts_open(roots, fts_options, NULL)) == NULL) {
         warn("fts_open");
-        goto out;
+        return 0;
     }
     /* Initialize ftsp with as many icon_dirs as possible. */
     chp = fts_children(ftsp, 0);
     if (chp == NULL) {
-        goto out;               /* no files to traverse */
+        fts_close(ftsp);
+        return 1;               /* no files to traverse */
     }
-    d_c = f_c = 0;
     while ((p = fts_read(ftsp)) != NULL) {
         switch (p->fts_info) {
         case FTS_D:
             //printf("d %s\n", p->fts_path);
-            d_c++;
+            if (sc->record_dirs
+                && !appendIconDir(&(sc->dl), p->fts_path,
+                                  &(p->fts_statp->st_mtim),
+                                  p->fts_level == FTS_ROOTLEVEL))
+                msg(-1, "can't remember icon dir %s\n", p->fts_path);
+            sc->d_c++;
             break;
         case FTS_F:
             //msg(1, "f %s\n", p->fts_path);
-            inspectIconMeta(p);
-            f_c++;
+            inspectIconMeta(&(sc->ic), p);
+            sc->f_c++;
             break;
         default:
             break;
         }
     }
     fts_close(ftsp);
+    return 1;
+}
+#endif
+
+//
+// walk single icon root into the partial hash sc->ic:
+// only directories from index.theme, if known,
+// or the whole tree otherwise
+// 1=success
+//
+static int scanIconRoot(iconscan_t * sc)
+{
+    char **sub;
+
+    if (sc->subdirs != NULL) {
+        if (sc->record_dirs) {
+            if (!recordIconDir(sc, sc->dir, true))
+                return 1;
+        } else if (access(sc->dir, F_OK) == -1) {
+            return 1;
+        }
+        sc->d_c++;
+        for (sub = sc->subdirs; *sub != NULL; sub++)
+            scanIconSubdir(sc, *sub);
+        return 1;
+    }
+// fts(3) stats every entry; getdents64 tells entry types itself
+#ifdef ICONSCAN_DENTS
+    return scanIconRootDents(sc);
+#else
+    return scanIconRootFts(sc);
+#endif
+}
+
+//
+// scan thread: take next unscanned root until none left
+//
+static void *iconScanWorker(void *arg)
+{
+    iconscanpool_t *pool = (iconscanpool_t *) arg;
+    int s;
+
+    while (true) {
+        pthread_mutex_lock(&(pool->lock));
+        s = pool->next++;
+        pthread_mutex_unlock(&(pool->lock));
+        if (s >= pool->nscans)
+            break;
+        scanIconRoot(&(pool->scans[s]));
+    }
+    return NULL;
+}
+
+//
+// move icons from partial hash *src into *dst,
+// keeping the better match and all sizes in the same way as inspectIconMeta.
+// only_new: take only apps *dst doesn't have (inherited theme)
+//
+static void mergeIconHash(icon_t ** dst, icon_t ** src, bool only_new)
+{
+    icon_t *iiter, *tmp, *ic;
+    int i;
+
+    HASH_ITER(hh, *src, iiter, tmp) {
+        HASH_DEL(*src, iiter);
+        HASH_FIND_STR(*dst, iiter->app, ic);
+        if (ic == NULL) {
+            HASH_ADD_KEYPTR(hh, *dst, iiter->app, strlen(iiter->app), iiter);
+            continue;
+        }
+        if (only_new) {
+            deleteIcon(iiter);
+            continue;
+        }
+        if (iconMatchBetter(iiter->src_w, iiter->src_h,
+                            ic->src_w, ic->src_h, false)) {
+            ic->src_dir = iiter->src_dir;
+            ic->src_name = iiter->src_name;
+            ic->src_w = iiter->src_w;
+            ic->src_h = iiter->src_h;
+            ic->ext = iiter->ext;
+            ic->dir = iiter->dir;
+        }
+        for (i = 0; i < iiter->nsizes; i++)
+            addSizeEntry(ic, &(iiter->sizes[i]));
+        deleteIcon(iiter);
+    }
+}
+
+//
+// move directory records from src to the end of dst
+//
+static void mergeIconDirList(icondirlist_t * dst, icondirlist_t * src)
+{
+    icondir_t *nd;
+    int i;
+
+    if (dst->n + src->n > dst->size) {
+        nd = realloc(dst->d, (dst->n + src->n) * sizeof(icondir_t));
+        if (nd == NULL) {
+            msg(-1, "can't merge icon dir lists\n");
+            freeIconDirList(src);
+            return;
+        }
+        dst->d = nd;
+        dst->size = dst->n + src->n;
+    }
+    for (i = 0; i < src->n; i++)
+        dst->d[dst->n++] = src->d[i];
+    free(src->d);
+    src->d = NULL;
+    src->n = src->size = 0;
+}
+
+//
+// load all icons
+// (no pixmaps, just path and dimension)
+// if dl isn't NULL, then record visited directories there
+//
+// every root is walked into its own partial hash, by a pool
+// of threads when there are several roots and cores.
+// partial hashes are merged in order of roots,
+// so the result is the same as of a single serial walk.
+// inherited themes only add apps which option_theme doesn't have.
+//
+int updateIconsFromFile(icon_t ** ihash, icondirlist_t * dl)
+{
+    char *icon_dirs[MAXICONDIRS];
+    int d_c, f_c;
+    int nscans, nthreads, ncpu, s, t;
+    iconscanpool_t pool;
+    pthread_t *threads;
+    icon_t *iiter, *tmp, *fallback = NULL;
+    const char *tnames[MAXICONTHEMES], *rt;
+    icontheme_t themes[MAXICONTHEMES];
+    bool tfound[MAXICONTHEMES];
+    int nthemes = 0, th;
+
+    nscans = allocIconDirs(icon_dirs);
+    if (nscans <= 0) {
+        destroyIconDirs(icon_dirs);
+        return 0;
+    }
+    pool.scans = calloc(nscans, sizeof(iconscan_t));
+    if (pool.scans == NULL) {
+        destroyIconDirs(icon_dirs);
+        return 0;
+    }
+    for (s = 0; s < nscans; s++) {
+        pool.scans[s].dir = icon_dirs[s];
+        pool.scans[s].ic = NULL;    // required by uthash
+        pool.scans[s].record_dirs = (dl != NULL);
+        // index.theme of each theme is read once
+        if ((rt = iconRootTheme(icon_dirs[s])) == NULL)
+            continue;
+        for (th = 0; th < nthemes && strcmp(tnames[th], rt) != 0; th++) ;
+        if (th == nthemes && nthemes < MAXICONTHEMES) {
+            tnames[th] = rt;
+            tfound[th] = readIconTheme(icon_dirs, rt, &(themes[th]));
+            nthemes++;
+        }
+        if (th < nthemes && tfound[th])
+            pool.scans[s].subdirs = themes[th].dirs;
+        pool.scans[s].inherited = (strcmp(rt, g.option_theme) != 0);
+    }
+    pool.nscans = nscans;
+    pool.next = 0;
+    pthread_mutex_init(&(pool.lock), NULL);
+
+    ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpu < nscans) ? ncpu : nscans;
+    if (nthreads < 1)
+        nthreads = 1;
+    msg(0, "scanning %d icon dirs in %d thread(s)\n", nscans, nthreads);
+    // this thread is a worker too
+    threads = calloc(nthreads, sizeof(pthread_t));
+    for (t = 1; threads != NULL && t < nthreads; t++) {
+        if (pthread_create(&(threads[t]), NULL, iconScanWorker, &pool) != 0) {
+            msg(-1, "can't create icon scan thread\n");
+            break;
+        }
+    }
+    iconScanWorker(&pool);
+    for (t--; threads != NULL && t >= 1; t--)
+        pthread_join(threads[t], NULL);
+    free(threads);
+    pthread_mutex_destroy(&(pool.lock));
+
+    d_c = f_c = 0;
+    for (s = 0; s < nscans; s++) {
+        if (!pool.scans[s].inherited) {
+            mergeIconHash(ihash, &(pool.scans[s].ic), false);
+        } else {
+            // all roots of inherited theme, then apps new to *ihash
+            mergeIconHash(&fallback, &(pool.scans[s].ic), false);
+            if (s + 1 == nscans || !pool.scans[s + 1].inherited
+                || strcmp(iconRootTheme(icon_dirs[s]),
+                          iconRootTheme(icon_dirs[s + 1])) != 0)
+                mergeIconHash(ihash, &fallback, true);
+        }
+        if (dl != NULL)
+            mergeIconDirList(dl, &(pool.scans[s].dl));
+        d_c += pool.scans[s].d_c;
+        f_c += pool.scans[s].f_c;
+    }
+    free(pool.scans);
+    for (th = 0; th < nthemes; th++) {
+        if (tfound[th])
+            freeIconTheme(&(themes[th]));
+    }
+
     if (g.debug > 0) {
         msg(0, "icon dirs: %d, files: %d, apps: %d\n", d_c,
             f_c, HASH_COUNT(*ihash));
         if (g.debug > 1) {
             HASH_ITER(hh, *ihash, iiter, tmp) {
-                msg(1, "app \"%s\" [%s] (%dx%d)\n",
-                    iiter->app, iiter->src_path, iiter->src_w, iiter->src_h);
+                msg(1, "app \"%s\" [%s/%s] (%dx%d)\n", iiter->app,
+                    iiter->src_dir, iiter->src_name, iiter->src_w,
+                    iiter->src_h);
             }
         }
     }
-    ret = 1;
 
-out:
     destroyIconDirs(icon_dirs);
-    return ret;
+    return 1;
 }   // updateIconsFromFile
 
 //
-// check if the file has better icon for given app than in g.ic
+// check if the file has better icon for given app than in *ihash.
+// fname, parent and gparent are names of the file,
+// its directory and directory above.
+// *used, if not NULL, is set to hash entry which got the file.
 // return 1 if this icon is used, 0 otherwise
 //
-int inspectIconMeta(FTSENT * pe)
+static int inspectIconFile(icon_t ** ihash, char *path, char *fname,
+                           char *parent, char *gparent, int gparentlen,
+                           icon_t ** used)
 {
     char *point;
-    char *fname;
     char app[MAXAPPLEN];
     int applen;
     char *xchar;
@@ -275,9 +1305,11 @@ int inspectIconMeta(FTSENT * pe)
     char *legacy_dim_suffixes[] = { "16", "24", "32", "48", "64", NULL };
     int dir = ICON_DIR_FREEDESKTOP;
     int ext = ICON_EXT_UNKNOWN;
+    int sized;
     const char *special_fail_1 = "failed to interpret %s as app_WWxHH at %s\n";
 
-    fname = pe->fts_name;
+    if (used != NULL)
+        *used = NULL;
     point = strrchr(fname, '.');
     if (point == NULL)
         return 0;               // no extension?
@@ -289,11 +1321,11 @@ int inspectIconMeta(FTSENT * pe)
     if (ext == ICON_EXT_UNKNOWN)
         return 0;
 
-    if (strstr(pe->fts_parent->fts_name, "pixmap") != NULL)
+    if (strstr(parent, "pixmap") != NULL)
         dir = ICON_DIR_LEGACY;
 
     // skip non-apps freedesktop icons
-    if (dir == ICON_DIR_FREEDESKTOP && strcmp(pe->fts_parent->fts_name, "apps") != 0)
+    if (dir == ICON_DIR_FREEDESKTOP && strcmp(parent, "apps") != 0)
         return 0;
 
     // guess app
@@ -305,8 +1337,8 @@ int inspectIconMeta(FTSENT * pe)
 
     // guess dimensions by directory
     if (dir == ICON_DIR_FREEDESKTOP) {
-        dim = pe->fts_parent->fts_parent->fts_name;
-        dimlen = pe->fts_parent->fts_parent->fts_namelen;
+        dim = gparent;
+        dimlen = gparentlen;
         xchar = strchr(dim, 'x');
         if (xchar == NULL)
             return 0;               // unknown dimensions
@@ -397,25 +1429,37 @@ end_special_1:
     }
 
     // is app already in hash?
-    HASH_FIND_STR(g.ic, app, ic);
+    HASH_FIND_STR(*ihash, app, ic);
     if (ic == NULL) {
         ic = initIcon();
         if (ic == NULL)
             return 0;
-        strncpy(ic->app, app, MAXAPPLEN);
-        strncpy(ic->src_path, pe->fts_path, MAXICONPATHLEN-1);
+        if ((ic->app = iconIntern(app, strlen(app))) == NULL
+            || !setIconSrc(ic, path)) {
+            deleteIcon(ic);
+            return 0;
+        }
         ic->src_w = ix;
         ic->src_h = iy;
         ic->ext = ext;
         ic->dir = dir;
-        HASH_ADD_STR(g.ic, app, ic);
+        HASH_ADD_KEYPTR(hh, *ihash, ic->app, strlen(ic->app), ic);
+        addIconSize(ic, path, ix, iy, ext, dir);
     } else {
         // we already have icon with dimensions: ic->src_w, h
         // new candidate: ix, iy
         // best value: g.option_iconW, H
         // should we replace the icon?
-        if (iconMatchBetter(ix, iy, ic->src_w, ic->src_h, false)) {
-            strncpy(ic->src_path, pe->fts_path, MAXICONPATHLEN-1);
+        // the same file again (rewritten) is kept.
+        // either way, remember the file if its size is new
+        sized = addIconSize(ic, path, ix, iy, ext, dir);
+        if (!iconSrcIs(ic, path)
+            && !iconMatchBetter(ix, iy, ic->src_w, ic->src_h, false)) {
+            if (!sized)
+                return 0;
+        } else {
+            if (!setIconSrc(ic, path))
+                return 0;
             ic->src_w = ix;
             ic->src_h = iy;
             ic->ext = ext;
@@ -423,14 +1467,55 @@ end_special_1:
         }
     }
 
+    if (used != NULL)
+        *used = ic;
     return 1;
-} // inspectIconMeta
+} // inspectIconFile
+
+//
+// check if the file found by scan has better icon than in *ihash
+// return 1 if this icon is used, 0 otherwise
+//
+int inspectIconMeta(icon_t ** ihash, FTSENT * pe)
+{
+    return inspectIconFile(ihash, pe->fts_path, pe->fts_name,
+                           pe->fts_parent->fts_name,
+                           pe->fts_parent->fts_parent->fts_name,
+                           pe->fts_parent->fts_parent->fts_namelen, NULL);
+}
+
+//
+// the same for file given by full path, like
+// /usr/share/icons/hicolor/48x48/apps/foo.png
+//
+int inspectIconPath(icon_t ** ihash, char *path, icon_t ** used)
+{
+    char buf[MAXICONPATHLEN];
+    char *comp[3] = { "", "", "" };   // file, parent, grandparent
+    char *sl;
+    int c;
+
+    strncpy(buf, path, MAXICONPATHLEN - 1);
+    buf[MAXICONPATHLEN - 1] = '\0';
+    for (c = 0; c < 3; c++) {
+        sl = strrchr(buf, '/');
+        if (sl == NULL) {
+            comp[c] = buf;
+            break;
+        }
+        comp[c] = sl + 1;
+        *sl = '\0';
+    }
+    return inspectIconFile(ihash, path, comp[0], comp[1], comp[2],
+                           strlen(comp[2]), used);
+}
 
 //
 // update Drawable from png file
 //
 int loadIconContentPNG(icon_t * ic)
 {
+    char path[MAXICONPATHLEN];
 
     if (!ic->drawable_allocated) {
         ic->drawable = XCreatePixmap(dpy, root, ic->src_w, ic->src_h, XDEPTH);
@@ -439,12 +1524,14 @@ int loadIconContentPNG(icon_t * ic)
             return 0;
         }
         ic->drawable_allocated = true;
+        ic->drawable_w = ic->src_w;
+        ic->drawable_h = ic->src_h;
     }
 
     if (pngReadToDrawable
-        (ic->src_path, ic->drawable, g.color[COLBG].xcolor.red,
+        (iconSrcPath(ic, path), ic->drawable, g.color[COLBG].xcolor.red,
          g.color[COLBG].xcolor.green, g.color[COLBG].xcolor.blue) == 0) {
-        msg(-1, "can't read png to drawable: %s\n", ic->src_path);
+        msg(-1, "can't read png to drawable: %s\n", path);
         return 0;
     }
 
@@ -456,19 +1543,195 @@ int loadIconContentPNG(icon_t * ic)
 //
 int loadIconContentXPM(icon_t * ic)
 {
+    char path[MAXICONPATHLEN];
+    XpmAttributes xa;
     int ret;
 
-    ret = (XpmReadFileToPixmap(dpy, root, ic->src_path, &(ic->drawable),
-                &(ic->mask), NULL) == XpmSuccess) ? 1 : 0;
+    // size comes back in xa, so tiles needn't ask the server for it
+    xa.valuemask = 0;
+    ret = (XpmReadFileToPixmap(dpy, root, iconSrcPath(ic, path), &(ic->drawable),
+                &(ic->mask), &xa) == XpmSuccess) ? 1 : 0;
     if (ret == 1) {
         ic->drawable_allocated = true;
+        ic->drawable_w = xa.width;
+        ic->drawable_h = xa.height;
+        XpmFreeAttributes(&xa);
     } else {
-        msg(-1, "can't read xpm to drawable: %s\n", ic->src_path);
+        msg(-1, "can't read xpm to drawable: %s\n", path);
     }
 
     return ret;
 }
 
+//
+// decode xpm file into premultiplied ARGB pixels.
+// return malloc'ed w*h array or NULL
+//
+static uint32_t *xpmReadToARGB(char *path, unsigned int *w, unsigned int *h)
+{
+    XpmImage xi;
+    XpmColor *xc;
+    XColor col;
+    uint32_t *colors, *argb;
+    char *name;
+    unsigned int c, i, npix;
+
+    if (XpmReadFileToXpmImage(path, &xi, NULL) != XpmSuccess) {
+        msg(-1, "can't read xpm: %s\n", path);
+        return NULL;
+    }
+    npix = xi.width * xi.height;
+    colors = malloc(xi.ncolors * sizeof(uint32_t));
+    argb = malloc(npix * sizeof(uint32_t));
+    if (colors == NULL || argb == NULL || npix == 0) {
+        free(colors);
+        free(argb);
+        XpmFreeXpmImage(&xi);
+        return NULL;
+    }
+    for (c = 0; c < xi.ncolors; c++) {
+        xc = &(xi.colorTable[c]);
+        name = xc->c_color ? xc->c_color : xc->g_color ? xc->g_color :
+            xc->g4_color ? xc->g4_color : xc->m_color;
+        if (name == NULL || strcasecmp(name, "None") == 0
+            || !XParseColor(dpy, DefaultColormap(dpy, scr), name, &col))
+            colors[c] = 0;      // transparent
+        else
+            colors[c] = 0xff000000 | ((col.red >> 8) << 16)
+                | ((col.green >> 8) << 8) | (col.blue >> 8);
+    }
+    for (i = 0; i < npix; i++)
+        argb[i] = (xi.data[i] < xi.ncolors) ? colors[xi.data[i]] : 0;
+    *w = xi.width;
+    *h = xi.height;
+    free(colors);
+    XpmFreeXpmImage(&xi);
+    return argb;
+}
+
+//
+// create pixmap from premultiplied ARGB pixels,
+// composing them with background color
+//
+static Pixmap argbToPixmap(uint32_t * argb, unsigned int w, unsigned int h)
+{
+    uint32_t *image32;
+    XImage *img;
+    Pixmap pm;
+    unsigned int i;
+    CompositeConst cc = initCompositeConst(g.color[COLBG].xcolor.pixel);
+
+    image32 = malloc(w * h * 4);
+    if (image32 == NULL)
+        return None;
+    for (i = 0; i < w * h; i++)
+        image32[i] = pixelCompositePremul(argb[i], &cc);
+    img = XCreateImage(dpy, CopyFromParent, XDEPTH, ZPixmap, 0,
+                       (char *)image32, w, h, 32, 0);
+    if (!img) {
+        free(image32);
+        return None;
+    }
+    pm = XCreatePixmap(dpy, root, w, h, XDEPTH);
+    if (pm != None)
+        XPutImage(dpy, pm, DefaultGC(dpy, scr), img, 0, 0, 0, 0, w, h);
+    XFree(img);
+    free(image32);
+    return pm;
+}
+
+//
+// create clip mask from alpha of ARGB pixels,
+// like the one XpmReadFileToPixmap makes for "None" color.
+// return None if all pixels are opaque
+//
+static Pixmap argbToMask(uint32_t * argb, unsigned int w, unsigned int h)
+{
+    unsigned int x, y, bpl = (w + 7) / 8;
+    bool opaque = true;
+    char *bits;
+    Pixmap mask;
+
+    for (x = 0; x < w * h && opaque; x++)
+        opaque = (argb[x] >> 24) >= 0x80;
+    if (opaque)
+        return None;
+    bits = calloc(bpl * h, 1);
+    if (bits == NULL)
+        return None;
+    for (y = 0; y < h; y++)
+        for (x = 0; x < w; x++)
+            if ((argb[y * w + x] >> 24) >= 0x80)
+                bits[y * bpl + x / 8] |= 1 << (x % 8);
+    mask = XCreateBitmapFromData(dpy, root, bits, w, h);
+    free(bits);
+    return mask;
+}
+
+//
+// update drawable with icon already scaled to w x h,
+// decoding the file closest to this size
+// or taking pixels from cache if the file is unchanged.
+// then tiles just copy it.
+// xpm keeps its transparent pixels as clip mask;
+// png is composed with background, as in loadIconContentPNG.
+//
+int loadIconContentScaled(icon_t * ic, unsigned int w, unsigned int h)
+{
+    char path[MAXICONPATHLEN];
+    struct stat st;
+    unsigned int sw, sh;
+    uint32_t *pix, *src = NULL;
+    iconsize_t *is;
+    int ext = ic->ext;
+    Pixmap pm, mask = None;
+
+    if (w == 0 || h == 0)
+        return 0;
+    is = closestIconSize(ic, h);
+    if (is != NULL) {
+        snprintf(path, MAXICONPATHLEN, "%s/%s", is->src_dir, is->src_name);
+        ext = is->ext;
+    } else {
+        iconSrcPath(ic, path);
+    }
+    if (stat(path, &st) == -1)
+        return 0;
+    pix = malloc(w * h * sizeof(uint32_t));
+    if (pix == NULL)
+        return 0;
+    if (!loadIconPixels(path, &st, w, h, pix)) {
+        msg(1, "decoding %s for %ux%u icon\n", path, w, h);
+        if (ext == ICON_EXT_PNG)
+            src = pngReadToARGB(path, &sw, &sh);
+        else if (ext == ICON_EXT_XPM)
+            src = xpmReadToARGB(path, &sw, &sh);
+        if (src == NULL || !argbFit(src, sw, sh, pix, w, h)) {
+            free(src);
+            free(pix);
+            return 0;
+        }
+        free(src);
+        saveIconPixels(path, &st, w, h, pix);
+    }
+    pm = argbToPixmap(pix, w, h);
+    if (pm != None && ext == ICON_EXT_XPM)
+        mask = argbToMask(pix, w, h);
+    free(pix);
+    if (pm == None)
+        return 0;
+    if (ic->drawable_allocated)
+        XFreePixmap(dpy, ic->drawable);
+    if (ic->mask != None)
+        XFreePixmap(dpy, ic->mask);
+    ic->drawable = pm;
+    ic->mask = mask;
+    ic->drawable_allocated = true;
+    ic->drawable_w = w;
+    ic->drawable_h = h;
+    return 1;
+}
+
 //
 // update drawable
 //
@@ -476,6 +1739,8 @@ int loadIconContent(icon_t * ic)
 {
     int ret;
 
+    if (loadIconContentScaled(ic, g.option_iconW, g.option_iconH))
+        return 1;
     if (ic->ext == ICON_EXT_PNG) {
         ret = loadIconContentPNG(ic);
     } else if (ic->ext == ICON_EXT_XPM) {
@@ -488,21 +1753,166 @@ int loadIconContent(icon_t * ic)
 }
 
 //
-// search app icon in hash,
+// make drawable w x h, when tiles are shrunk to fit the screen
+// or were shrunk last time.
+// drawable is kept on failure.
+// 1=drawable is w x h
+//
+int fitIconContent(icon_t * ic, unsigned int w, unsigned int h)
+{
+    if (ic->drawable != None && ic->drawable_w == w && ic->drawable_h == h)
+        return 1;
+    msg(0, "refitting icon for %s to %ux%u\n", ic->app, w, h);
+    return loadIconContentScaled(ic, w, h);
+}
+
+//
+// remember file path as icon of size w x h
+// return 1 if recorded or updated, 0 otherwise
+//
+int addIconSize(icon_t * ic, const char *path, unsigned int w,
+                unsigned int h, int ext, int dir)
+{
+    const char *sl = strrchr(path, '/');
+    iconsize_t is;
+
+    if (sl == NULL)
+        return 0;
+    is.src_dir = iconIntern(path, sl - path);
+    is.src_name = iconIntern(sl + 1, strlen(sl + 1));
+    if (is.src_dir == NULL || is.src_name == NULL)
+        return 0;
+    is.src_w = w;
+    is.src_h = h;
+    is.ext = ext;
+    is.dir = dir;
+    return addSizeEntry(ic, &is);
+}
+
+//
+// forget files of the icon which are path, or below path if dir.
+// if the source file is among them, the closest remaining size
+// becomes the source.
+// return the number of files forgotten
+//
+int dropIconSizes(icon_t * ic, const char *path, bool dir)
+{
+    iconsize_t *best;
+    bool src_gone = false;
+    int i, n = 0;
+
+    for (i = 0; i < ic->nsizes; i++) {
+        if (!sizeFromPath(&(ic->sizes[i]), path, dir)) {
+            ic->sizes[i - n] = ic->sizes[i];
+            continue;
+        }
+        if (ic->sizes[i].src_dir == ic->src_dir
+            && ic->sizes[i].src_name == ic->src_name)
+            src_gone = true;
+        n++;
+    }
+    ic->nsizes -= n;
+    if (src_gone && (best = closestIconSize(ic, g.option_iconH)) != NULL) {
+        ic->src_dir = best->src_dir;
+        ic->src_name = best->src_name;
+        ic->src_w = best->src_w;
+        ic->src_h = best->src_h;
+        ic->ext = best->ext;
+        ic->dir = best->dir;
+    }
+    return n;
+}
+
+//
+// search app icon in g.ic, case-insensitive,
 // return icon or NULL if not found
 //
 icon_t *lookupIcon(char *app)
 {
-    icon_t *ic;
-    char appl[MAXAPPLEN];
-    int l;
+    const char *k;
+    uint32_t h, i;
+    int l, c;
 
-    for (l = 0; (*(app + l)) != '\0' && l < MAXAPPLEN; l++)
-        appl[l] = tolower(*(app + l));
-    appl[l] = '\0';
+    if (itab_stale || itab_src != g.ic)
+        buildIconTable(g.ic);
+    if (itab == NULL)
+        return NULL;
+    h = iconNameHash(app, &l);
+    for (i = h & itab_mask; itab[i].hash != 0; i = (i + 1) & itab_mask) {
+        if (itab[i].hash != h)
+            continue;
+        // keys are lowercase already
+        k = itab[i].ic->app;
+        for (c = 0; c < l && k[c] == tolower((unsigned char)app[c]); c++) ;
+        if (c == l && k[l] == '\0')
+            return itab[i].ic;
+    }
+    return NULL;
+}
 
-    HASH_FIND_STR(g.ic, appl, ic);
-    return ic;
+//
+// g.ic entries were added or removed:
+// rebuild lookup table on next lookupIcon
+//
+void invalidateIconTable(void)
+{
+    itab_stale = true;
+    itab_gen++;
+}
+
+//
+// changes whenever g.ic does, so that lookup results
+// remembered outside can be checked for being outdated
+//
+unsigned int iconHashGeneration(void)
+{
+    return itab_gen;
+}
+
+//
+// full path of icon source file into buf of MAXICONPATHLEN
+// return buf
+//
+char *iconSrcPath(icon_t * ic, char *buf)
+{
+    if (ic->src_dir == NULL)
+        buf[0] = '\0';
+    else
+        snprintf(buf, MAXICONPATHLEN, "%s/%s", ic->src_dir, ic->src_name);
+    return buf;
+}
+
+//
+// is path the source file of icon?
+//
+bool iconSrcIs(icon_t * ic, const char *path)
+{
+    const char *sl = strrchr(path, '/');
+
+    return ic->src_dir != NULL && sl != NULL
+        && strncmp(ic->src_dir, path, sl - path) == 0
+        && ic->src_dir[sl - path] == '\0'
+        && strcmp(ic->src_name, sl + 1) == 0;
+}
+
+//
+// set source file of icon, interning its directory and name
+// 1=success
+//
+int setIconSrc(icon_t * ic, const char *path)
+{
+    const char *sl = strrchr(path, '/');
+    const char *d, *n;
+
+    if (sl == NULL)
+        return 0;
+    d = iconIntern(path, sl - path);
+    n = iconIntern(sl + 1, strlen(sl + 1));
+    if (d == NULL || n == NULL)
+        return 0;
+    ic->src_dir = d;
+    ic->src_name = n;
+    return 1;
 }
 
 //
@@ -512,17 +1922,7 @@ icon_t *lookupIcon(char *app)
 //
 bool iconMatchBetter(int new_w, int new_h, int old_w, int old_h, bool equal_prefer_new)
 {
-    int hasdiff, newdiff;
-
-    hasdiff = old_h - g.option_iconH;
-    newdiff = new_h - g.option_iconH;
-    if (hasdiff == newdiff && equal_prefer_new)
-        return true;
-    return
-        (hasdiff >= 0) ? ((newdiff < 0) ? false : ((newdiff <
-                                                    hasdiff) ? true : false)
-        ) : ((newdiff >= 0) ? true : ((newdiff > hasdiff) ? true : false)
-        );
+    return matchBetter(g.option_iconH, new_h, old_h, equal_prefer_new);
 }
 
 void deleteIconHash(icon_t **ihash)
@@ -34,15 +34,31 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 #include <fts.h>
 #include <stdio.h>
 #include <ctype.h>
+#include <stdint.h>
+#include <time.h>
+#include <pthread.h>
 
 #define MAXICONDIRS     64
 #define MAXAPPLEN       64
 #define MAXICONPATHLEN  1024
 #define MAXICONDIMLEN   5
+#define MAXICONTHEMES   16      // option_theme and themes it inherits
 
+// one of files found for an app, see icon_t.sizes
 typedef struct {
-    char app[MAXAPPLEN];        // application name; uthash key
-    char src_path[MAXICONPATHLEN];  // \0 -if not initialized or loaded from X window properties
+    const char *src_dir;        // interned, so the same file has the same pointers
+    const char *src_name;
+    unsigned int src_w, src_h;
+    unsigned char ext;
+    unsigned char dir;
+} iconsize_t;
+
+// strings are interned (see iconIntern), so directories are shared
+// between icons and the record stays small with thousands of apps
+typedef struct {
+    const char *app;            // application name, lowercase; uthash key
+    const char *src_dir;        // directory of source file; NULL if not initialized or loaded from X window properties
+    const char *src_name;       // source file name in src_dir
     unsigned int src_w, src_h;  // width/height of source (not resized) icon. may be 1x1 if unknown, so use it only for better icon selection, not for allocations
     Pixmap drawable;            // resized (ready to use)
     Pixmap mask;
@@ -50,25 +66,121 @@ typedef struct {
 #define ICON_EXT_UNKNOWN    0
 #define ICON_EXT_PNG        2
 #define ICON_EXT_XPM        3
-    unsigned int ext;
+    unsigned char ext;
 #define ICON_DIR_FREEDESKTOP   0   // in WxH/apps/
 #define ICON_DIR_LEGACY        1
-    unsigned int dir;
+    unsigned char dir;
+    iconsize_t *sizes;          // every available size, one file per size; src_* above is one of them
+    int nsizes, sizes_alloc;
+    unsigned int drawable_w, drawable_h;    // 0 if unknown
     UT_hash_handle hh;
 } icon_t;
 
+// slot of flat lookup table over icon hash, see lookupIcon
+typedef struct {
+    uint32_t hash;              // of lowercase app name; 0 if slot is empty
+    icon_t *ic;
+} iconslot_t;
+
+// arena chunk holding interned strings
+typedef struct iconstrchunk {
+    struct iconstrchunk *next;
+    size_t used, size;
+    char data[];
+} iconstrchunk_t;
+
+// index of interned strings
+typedef struct {
+    const char *s;
+    UT_hash_handle hh;
+} iconstr_t;
+
+// directory visited by icon scan,
+// its mtime validates the icon index
+typedef struct {
+    char *path;
+    struct timespec mtime;
+    bool root;                  // one of allocIconDirs()
+} icondir_t;
+
+typedef struct {
+    icondir_t *d;
+    int n, size;
+} icondirlist_t;
+
+// what index.theme tells, see readIconTheme
+typedef struct {
+    char **dirs;                // app context subdirectories, NULL-terminated
+    char **inherits;            // parent themes, NULL-terminated
+} icontheme_t;
+
+// icon root walked by updateIconsFromFile
+typedef struct {
+    char *dir;
+    char **subdirs;             // from index.theme; NULL: walk the whole tree
+    bool inherited;             // root of theme inherited by option_theme
+    icon_t *ic;                 // partial hash of this root
+    bool record_dirs;
+    icondirlist_t dl;
+    int d_c, f_c;               // statistics
+} iconscan_t;
+
+// roots shared by scan threads
+typedef struct {
+    iconscan_t *scans;
+    int nscans;
+    int next;                   // first root not taken yet
+    pthread_mutex_t lock;
+} iconscanpool_t;
+
+// system-wide location of persistent icon index, see iconcache.c
+#define ICONINDEX_SYSDIR    "/var/cache/alttab"
+
+const char *iconIntern(const char *s, size_t len);
+void freeIconStrings(void);
 icon_t *initIcon(void);
 void deleteIcon(icon_t * ic);
 int initIconHash(icon_t ** ihash);
+int startIconHash(void);        // build g.ic in background
+bool pollIconHash(bool wait);   // install it when ready
+int rescanIconHash(void);       // build g.ic again in background
 int allocIconDirs(char ** icon_dirs);
 void destroyIconDirs(char ** icon_dirs);
-int updateIconsFromFile(icon_t ** ihash);   // load all icons into hash (no pixmaps, just path and dimension)
-int inspectIconMeta(FTSENT * pe);   // check if file pe has better icon than we have in g.ic
+int updateIconsFromFile(icon_t ** ihash, icondirlist_t * dl);    // load all icons into hash (no pixmaps, just path and dimension)
+int inspectIconMeta(icon_t ** ihash, FTSENT * pe);  // check if file pe has better icon than we have in hash
+int inspectIconPath(icon_t ** ihash, char *path, icon_t ** used);   // the same by path
 int loadIconContentPNG(icon_t * ic);
 int loadIconContentXPM(icon_t * ic);
+int loadIconContentScaled(icon_t * ic, unsigned int w, unsigned int h);
 int loadIconContent(icon_t * ic);   // update drawable
+int fitIconContent(icon_t * ic, unsigned int w, unsigned int h);  // the same for actual icon size
+int addIconSize(icon_t * ic, const char *path, unsigned int w,
+                unsigned int h, int ext, int dir);
+int dropIconSizes(icon_t * ic, const char *path, bool dir);
 icon_t *lookupIcon(char *app);  // search app icon in hash
+void invalidateIconTable(void); // g.ic changed
+unsigned int iconHashGeneration(void);
+char *iconSrcPath(icon_t * ic, char *buf);   // full path, buf is MAXICONPATHLEN
+bool iconSrcIs(icon_t * ic, const char *path);
+int setIconSrc(icon_t * ic, const char *path);
 bool iconMatchBetter(int new_w, int new_h, int old_w, int old_h, bool equal_prefer_new);
 void deleteIconHash(icon_t **ihash);
+void freeIconDirList(icondirlist_t * dl);
+
+// iconcache.c
+int iconIndexPath(char *buf, size_t bufsize, bool system);
+int loadIconIndex(icon_t ** ihash, char *path);
+int saveIconIndex(icon_t * ihash, icondirlist_t * dl, char *path);
+int buildIconIndex(bool system);
+int loadIconPixels(char *src, struct stat *st, unsigned int w,
+                   unsigned int h, uint32_t * buf);
+int saveIconPixels(char *src, struct stat *st, unsigned int w,
+                   unsigned int h, uint32_t * buf);
+
+// iconwatch.c
+int initIconWatch(void);
+int iconWatchFd(void);
+int processIconWatch(icon_t ** ihash);
+void closeIconWatch(void);
 
 #endif
@@ -0,0 +1,697 @@
+/*
+Persistent icon index: icon_t metadata saved between runs.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <dirent.h>
+#include <sys/mman.h>
+#include "alttab.h"
+#include "icon.h"
+extern Globals g;
+
+// PRIVATE
+
+// The index is a single file in native byte order:
+//   header, directory records, icon records, string table.
+// Strings are referenced by offset into the string table.
+// There is an icon record per available size; the first record
+// of an app is the best match for icon size option.
+// It's valid while theme, icon size, the set of existing icon dirs
+// and mtimes of all directories visited by the scan are the same.
+
+#define ICONINDEX_MAGIC     0x58495441  // "ATIX"
+#define ICONINDEX_VERSION   2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t icon_h;            // iconMatchBetter depends on it
+    uint32_t theme;
+    uint32_t ndirs;
+    uint32_t nicons;            // records, not apps
+    uint32_t strsize;
+    uint32_t reserved;
+} iconindex_hdr_t;
+
+typedef struct {
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    uint32_t path;
+    uint32_t root;
+} iconindex_dir_t;
+
+typedef struct {
+    uint32_t app;
+    uint32_t src_path;
+    uint32_t src_w, src_h;
+    uint32_t ext, dir;
+} iconindex_icon_t;
+
+typedef struct {
+    char *s;
+    uint32_t len, size;
+} strtab_t;
+
+// Pixel cache: one file per icon file and size in
+// $XDG_CACHE_HOME/alttab/pixels/, named by hash of source path.
+// It holds the icon decoded and scaled to icon size, usually
+// option_iconW x option_iconH, or smaller when tiles are shrunk,
+// as premultiplied ARGB, so it doesn't depend on background color.
+// Header, source path, w*h pixels.
+// Outdated files are removed when found, and the oldest ones
+// when there are more than ICONPIXELS_MAXFILES.
+
+#define ICONPIXELS_MAGIC    0x58505441  // "ATPX"
+#define ICONPIXELS_VERSION  1
+#define ICONPIXELS_MAXFILES 2048
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    int64_t src_mtime_sec;
+    int64_t src_mtime_nsec;
+    int64_t src_size;
+    uint32_t w, h;
+    uint32_t pathlen;           // including \0
+    uint32_t reserved;
+} iconpixels_hdr_t;
+
+//
+// append string to table
+// return its offset or UINT32_MAX on failure
+//
+static uint32_t strtabAdd(strtab_t * t, const char *str)
+{
+    uint32_t off;
+    size_t sl = strlen(str) + 1;
+    char *ns;
+
+    while (t->len + sl > t->size) {
+        t->size = t->size ? t->size * 2 : 65536;
+        ns = realloc(t->s, t->size);
+        if (ns == NULL)
+            return UINT32_MAX;
+        t->s = ns;
+    }
+    off = t->len;
+    memcpy(t->s + off, str, sl);
+    t->len += sl;
+    return off;
+}
+
+//
+// mkdir -p for all directories in file path
+// 1=success
+//
+static int mkdirParents(char *path)
+{
+    char *sl;
+    int ret = 1;
+
+    for (sl = strchr(path + 1, '/'); sl != NULL; sl = strchr(sl + 1, '/')) {
+        *sl = '\0';
+        if (mkdir(path, 0755) == -1 && errno != EEXIST)
+            ret = 0;
+        *sl = '/';
+        if (ret == 0)
+            break;
+    }
+    return ret;
+}
+
+//
+// path to name in user's cache dir, $XDG_CACHE_HOME/alttab/
+// 1=success
+//
+static int userCachePath(char *buf, size_t bufsize, const char *name)
+{
+    char *xdgch = getenv("XDG_CACHE_HOME");
+    char *home = getenv("HOME");
+    int r;
+
+    if (xdgch != NULL && xdgch[0] == '/')
+        r = snprintf(buf, bufsize, "%s/alttab/%s", xdgch, name);
+    else if (home != NULL)
+        r = snprintf(buf, bufsize, "%s/.cache/alttab/%s", home, name);
+    else
+        return 0;
+    return (r > 0 && r < bufsize) ? 1 : 0;
+}
+
+//
+// pixel cache file for icon file src at w x h
+// 1=success
+//
+static int iconPixelsPath(char *buf, size_t bufsize, const char *src,
+                          unsigned int w, unsigned int h)
+{
+    char name[64];
+    uint64_t hash = 14695981039346656037ULL;   // FNV-1a
+    const char *c;
+
+    for (c = src; *c != '\0'; c++) {
+        hash ^= (unsigned char)*c;
+        hash *= 1099511628211ULL;
+    }
+    snprintf(name, sizeof(name), "pixels/%016llx-%ux%u.argb",
+             (unsigned long long)hash, w, h);
+    return userCachePath(buf, bufsize, name);
+}
+
+// pixel cache can't be written, don't try again
+static bool pixelsFailed = false;
+// pixel cache was trimmed in this run
+static bool pixelsTrimmed = false;
+
+//
+// complain about pixel cache once, then stop writing it
+//
+static void pixelsFailure(const char *what, const char *path)
+{
+    msg(-1, "%s %s, pixel cache disabled\n", what, path);
+    pixelsFailed = true;
+}
+
+typedef struct {
+    char name[64];
+    time_t mtime;
+} pixfile_t;
+
+static int pixfileOlder(const void *a, const void *b)
+{
+    time_t ta = ((const pixfile_t *)a)->mtime;
+    time_t tb = ((const pixfile_t *)b)->mtime;
+    return (ta > tb) - (ta < tb);
+}
+
+//
+// remove the oldest pixel cache files,
+// so that ICONPIXELS_MAXFILES * 3/4 remain.
+// dir is the pixels directory
+//
+static void trimIconPixels(const char *dir)
+{
+    DIR *d;
+    struct dirent *de;
+    struct stat st;
+    char path[MAXICONPATHLEN];
+    pixfile_t *files = NULL, *nf;
+    int n = 0, size = 0, i;
+
+    if ((d = opendir(dir)) == NULL)
+        return;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.' || strlen(de->d_name) >= sizeof(files->name))
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+        if (stat(path, &st) == -1 || !S_ISREG(st.st_mode))
+            continue;
+        if (n == size) {
+            size = size ? size * 2 : 256;
+            nf = realloc(files, size * sizeof(pixfile_t));
+            if (nf == NULL)
+                break;
+            files = nf;
+        }
+        strcpy(files[n].name, de->d_name);
+        files[n].mtime = st.st_mtime;
+        n++;
+    }
+    closedir(d);
+    if (n > ICONPIXELS_MAXFILES) {
+        qsort(files, n, sizeof(pixfile_t), pixfileOlder);
+        for (i = 0; i < n - ICONPIXELS_MAXFILES * 3 / 4; i++) {
+            snprintf(path, sizeof(path), "%s/%s", dir, files[i].name);
+            unlink(path);
+        }
+        msg(0, "pixel cache: %d old files removed\n", i);
+    }
+    free(files);
+}
+
+//
+// are roots and mtimes recorded in index still actual?
+//
+static bool iconIndexFresh(iconindex_dir_t * dirs, uint32_t ndirs,
+                           const char *strs)
+{
+    char *icon_dirs[MAXICONDIRS];
+    struct stat st;
+    uint32_t d, r;
+    bool fresh = false;
+
+    // the same existing icon roots in the same order
+    if (allocIconDirs(icon_dirs) <= 0)
+        return false;
+    for (d = 0, r = 0; icon_dirs[r] != NULL; r++) {
+        if (stat(icon_dirs[r], &st) == -1 || !S_ISDIR(st.st_mode))
+            continue;
+        while (d < ndirs && !dirs[d].root)
+            d++;
+        if (d == ndirs || strcmp(strs + dirs[d].path, icon_dirs[r]) != 0) {
+            msg(0, "icon index: set of icon dirs changed at %s\n",
+                icon_dirs[r]);
+            goto out;
+        }
+        d++;
+    }
+    for (; d < ndirs; d++) {
+        if (dirs[d].root) {
+            msg(0, "icon index: %s vanished\n", strs + dirs[d].path);
+            goto out;
+        }
+    }
+    // nothing added or removed anywhere in the tree
+    for (d = 0; d < ndirs; d++) {
+        if (stat(strs + dirs[d].path, &st) == -1
+            || st.st_mtim.tv_sec != dirs[d].mtime_sec
+            || st.st_mtim.tv_nsec != dirs[d].mtime_nsec) {
+            msg(0, "icon index: %s changed\n", strs + dirs[d].path);
+            goto out;
+        }
+    }
+    fresh = true;
+
+ out:
+    destroyIconDirs(icon_dirs);
+    return fresh;
+}
+
+// PUBLIC
+
+//
+// path to icon index of current theme:
+// user's ($XDG_CACHE_HOME/alttab/) or system-wide (ICONINDEX_SYSDIR)
+// 1=success
+//
+int iconIndexPath(char *buf, size_t bufsize, bool system)
+{
+    char name[MAXAPPLEN + 16];
+    char *s;
+    int r;
+
+    snprintf(name, sizeof(name), "icons-%s.idx", g.option_theme);
+    for (s = name; (s = strchr(s, '/')) != NULL; s++)
+        *s = '_';
+
+    if (!system)
+        return userCachePath(buf, bufsize, name);
+    r = snprintf(buf, bufsize, "%s/%s", ICONINDEX_SYSDIR, name);
+    return (r > 0 && r < bufsize) ? 1 : 0;
+}
+
+//
+// map the index from path and fill the hash, if the index is fresh.
+// ihash is untouched on failure.
+// 1=success
+//
+int loadIconIndex(icon_t ** ihash, char *path)
+{
+    int fd;
+    struct stat st;
+    char *map;
+    iconindex_hdr_t *hdr;
+    iconindex_dir_t *dirs;
+    iconindex_icon_t *icons;
+    const char *strs;
+    uint64_t expect;
+    uint32_t i, napps = 0;
+    icon_t *ic;
+    int ret = 0;
+
+    fd = open(path, O_RDONLY);
+    if (fd == -1) {
+        msg(0, "no icon index %s\n", path);
+        return 0;
+    }
+    if (fstat(fd, &st) == -1 || st.st_size < sizeof(iconindex_hdr_t)) {
+        close(fd);
+        return 0;
+    }
+    map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        msg(-1, "can't map icon index %s\n", path);
+        return 0;
+    }
+
+    hdr = (iconindex_hdr_t *) map;
+    if (hdr->magic != ICONINDEX_MAGIC || hdr->version != ICONINDEX_VERSION) {
+        msg(0, "icon index %s: unknown format\n", path);
+        goto out;
+    }
+    expect = sizeof(iconindex_hdr_t)
+        + (uint64_t) hdr->ndirs * sizeof(iconindex_dir_t)
+        + (uint64_t) hdr->nicons * sizeof(iconindex_icon_t)
+        + hdr->strsize;
+    if (expect != st.st_size || hdr->strsize == 0) {
+        msg(-1, "icon index %s is truncated\n", path);
+        goto out;
+    }
+    dirs = (iconindex_dir_t *) (map + sizeof(iconindex_hdr_t));
+    icons = (iconindex_icon_t *) (dirs + hdr->ndirs);
+    strs = (const char *)(icons + hdr->nicons);
+    // every offset below strsize is then a terminated string
+    if (strs[hdr->strsize - 1] != '\0' || hdr->theme >= hdr->strsize)
+        goto out;
+    for (i = 0; i < hdr->ndirs; i++) {
+        if (dirs[i].path >= hdr->strsize)
+            goto out;
+    }
+    // ext and dir aren't offsets, but they choose the loader
+    for (i = 0; i < hdr->nicons; i++) {
+        if (icons[i].app >= hdr->strsize
+            || icons[i].src_path >= hdr->strsize
+            || (icons[i].ext != ICON_EXT_UNKNOWN
+                && icons[i].ext != ICON_EXT_PNG
+                && icons[i].ext != ICON_EXT_XPM)
+            || (icons[i].dir != ICON_DIR_FREEDESKTOP
+                && icons[i].dir != ICON_DIR_LEGACY))
+            goto out;
+    }
+
+    if (hdr->icon_h != g.option_iconH
+        || strcmp(strs + hdr->theme, g.option_theme) != 0) {
+        msg(0, "icon index %s: built for another theme or icon size\n",
+            path);
+        goto out;
+    }
+    if (!iconIndexFresh(dirs, hdr->ndirs, strs))
+        goto out;
+
+    for (i = 0; i < hdr->nicons; i++) {
+        HASH_FIND_STR(*ihash, strs + icons[i].app, ic);
+        if (ic != NULL) {
+            addIconSize(ic, strs + icons[i].src_path, icons[i].src_w,
+                        icons[i].src_h, icons[i].ext, icons[i].dir);
+            continue;
+        }
+        ic = initIcon();
+        if (ic == NULL) {
+            deleteIconHash(ihash);
+            goto out;
+        }
+        ic->app = iconIntern(strs + icons[i].app,
+                             strlen(strs + icons[i].app));
+        if (ic->app == NULL || !setIconSrc(ic, strs + icons[i].src_path)) {
+            deleteIcon(ic);
+            deleteIconHash(ihash);
+            goto out;
+        }
+        ic->src_w = icons[i].src_w;
+        ic->src_h = icons[i].src_h;
+        ic->ext = icons[i].ext;
+        ic->dir = icons[i].dir;
+        HASH_ADD_KEYPTR(hh, *ihash, ic->app, strlen(ic->app), ic);
+        addIconSize(ic, strs + icons[i].src_path, ic->src_w, ic->src_h,
+                    ic->ext, ic->dir);
+        napps++;
+    }
+    msg(0, "icon index %s: %u dirs, %u apps, %u files\n", path,
+        hdr->ndirs, napps, hdr->nicons);
+    ret = 1;
+
+ out:
+    munmap(map, st.st_size);
+    return ret;
+}
+
+//
+// write hash and directories visited by scan to path,
+// atomically replacing previous index
+// 1=success
+//
+int saveIconIndex(icon_t * ihash, icondirlist_t * dl, char *path)
+{
+    iconindex_hdr_t hdr;
+    iconindex_dir_t *dirs = NULL;
+    iconindex_icon_t *icons = NULL;
+    strtab_t st = { NULL, 0, 0 };
+    icon_t *iiter, *tmp;
+    char tmppath[MAXICONPATHLEN];
+    char dpath[MAXICONPATHLEN];
+    char spath[MAXICONPATHLEN];
+    int fd = -1;
+    FILE *f = NULL;
+    uint32_t i;
+    int s, ret = 0;
+
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = ICONINDEX_MAGIC;
+    hdr.version = ICONINDEX_VERSION;
+    hdr.icon_h = g.option_iconH;
+    hdr.ndirs = dl->n;
+    hdr.nicons = 0;
+    HASH_ITER(hh, ihash, iiter, tmp) {
+        hdr.nicons++;
+        for (s = 0; s < iiter->nsizes; s++) {
+            if (iiter->sizes[s].src_dir != iiter->src_dir
+                || iiter->sizes[s].src_name != iiter->src_name)
+                hdr.nicons++;
+        }
+    }
+    dirs = calloc(hdr.ndirs + 1, sizeof(iconindex_dir_t));
+    icons = calloc(hdr.nicons + 1, sizeof(iconindex_icon_t));
+    if (dirs == NULL || icons == NULL)
+        goto out;
+    if ((hdr.theme = strtabAdd(&st, g.option_theme)) == UINT32_MAX)
+        goto out;
+    for (i = 0; i < hdr.ndirs; i++) {
+        dirs[i].mtime_sec = dl->d[i].mtime.tv_sec;
+        dirs[i].mtime_nsec = dl->d[i].mtime.tv_nsec;
+        dirs[i].root = dl->d[i].root;
+        if ((dirs[i].path = strtabAdd(&st, dl->d[i].path)) == UINT32_MAX)
+            goto out;
+    }
+    i = 0;
+    HASH_ITER(hh, ihash, iiter, tmp) {
+        icons[i].app = strtabAdd(&st, iiter->app);
+        icons[i].src_path = strtabAdd(&st, iconSrcPath(iiter, spath));
+        if (icons[i].app == UINT32_MAX || icons[i].src_path == UINT32_MAX)
+            goto out;
+        icons[i].src_w = iiter->src_w;
+        icons[i].src_h = iiter->src_h;
+        icons[i].ext = iiter->ext;
+        icons[i].dir = iiter->dir;
+        i++;
+        // other sizes after the best one
+        for (s = 0; s < iiter->nsizes; s++) {
+            if (iiter->sizes[s].src_dir == iiter->src_dir
+                && iiter->sizes[s].src_name == iiter->src_name)
+                continue;
+            icons[i].app = icons[i - 1].app;
+            snprintf(spath, MAXICONPATHLEN, "%s/%s",
+                     iiter->sizes[s].src_dir, iiter->sizes[s].src_name);
+            icons[i].src_path = strtabAdd(&st, spath);
+            if (icons[i].src_path == UINT32_MAX)
+                goto out;
+            icons[i].src_w = iiter->sizes[s].src_w;
+            icons[i].src_h = iiter->sizes[s].src_h;
+            icons[i].ext = iiter->sizes[s].ext;
+            icons[i].dir = iiter->sizes[s].dir;
+            i++;
+        }
+    }
+    hdr.strsize = st.len;
+
+    strncpy(dpath, path, MAXICONPATHLEN - 1);
+    dpath[MAXICONPATHLEN - 1] = '\0';
+    if (!mkdirParents(dpath)) {
+        msg(-1, "can't create directory for %s\n", path);
+        goto out;
+    }
+    if (snprintf(tmppath, MAXICONPATHLEN, "%s.XXXXXX", path) >=
+        MAXICONPATHLEN)
+        goto out;
+    if ((fd = mkstemp(tmppath)) == -1) {
+        msg(-1, "can't create %s\n", tmppath);
+        goto out;
+    }
+    // system-wide index is read by everybody
+    fchmod(fd, 0644);
+    if ((f = fdopen(fd, "w")) == NULL) {
+        close(fd);
+        unlink(tmppath);
+        goto out;
+    }
+    if (fwrite(&hdr, sizeof(hdr), 1, f) != 1
+        || fwrite(dirs, sizeof(iconindex_dir_t), hdr.ndirs, f) != hdr.ndirs
+        || fwrite(icons, sizeof(iconindex_icon_t), hdr.nicons,
+                  f) != hdr.nicons || fwrite(st.s, 1, st.len, f) != st.len) {
+        msg(-1, "can't write %s\n", tmppath);
+        fclose(f);
+        unlink(tmppath);
+        goto out;
+    }
+    if (fclose(f) != 0 || rename(tmppath, path) == -1) {
+        msg(-1, "can't save icon index %s\n", path);
+        unlink(tmppath);
+        goto out;
+    }
+    msg(0, "icon index saved: %s\n", path);
+    ret = 1;
+
+ out:
+    free(st.s);
+    free(icons);
+    free(dirs);
+    return ret;
+}
+
+//
+// read cached pixels of icon file src, whose stat is st,
+// scaled to w x h, into buf (w*h elements)
+// 1=success, 0=no or outdated cache
+//
+int loadIconPixels(char *src, struct stat *st, unsigned int w,
+                   unsigned int h, uint32_t * buf)
+{
+    char path[MAXICONPATHLEN];
+    char cpath[MAXICONPATHLEN];
+    iconpixels_hdr_t hdr;
+    size_t npix = (size_t)w * h;
+    int fd;
+    int ret = 0;
+
+    if (!iconPixelsPath(path, sizeof(path), src, w, h))
+        return 0;
+    if ((fd = open(path, O_RDONLY)) == -1)
+        return 0;
+    if (read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || hdr.magic != ICONPIXELS_MAGIC
+        || hdr.version != ICONPIXELS_VERSION
+        || hdr.w != w || hdr.h != h
+        || hdr.pathlen == 0 || hdr.pathlen > MAXICONPATHLEN)
+        goto out;
+    if (hdr.src_mtime_sec != st->st_mtim.tv_sec
+        || hdr.src_mtime_nsec != st->st_mtim.tv_nsec
+        || hdr.src_size != st->st_size) {
+        // source changed: this file is useless
+        msg(1, "outdated pixels for %s: %s\n", src, path);
+        unlink(path);
+        goto out;
+    }
+    // different file with the same hash?
+    if (read(fd, cpath, hdr.pathlen) != hdr.pathlen
+        || cpath[hdr.pathlen - 1] != '\0' || strcmp(cpath, src) != 0)
+        goto out;
+    if (read(fd, buf, npix * sizeof(uint32_t)) != npix * sizeof(uint32_t))
+        goto out;
+    msg(1, "cached pixels for %s: %s\n", src, path);
+    ret = 1;
+
+ out:
+    close(fd);
+    return ret;
+}
+
+//
+// cache pixels of icon file src (see loadIconPixels)
+// 1=success
+//
+int saveIconPixels(char *src, struct stat *st, unsigned int w,
+                   unsigned int h, uint32_t * buf)
+{
+    char path[MAXICONPATHLEN];
+    char tmppath[MAXICONPATHLEN];
+    iconpixels_hdr_t hdr;
+    size_t npix = (size_t)w * h;
+    int fd;
+
+    if (pixelsFailed)
+        return 0;
+    if (!iconPixelsPath(path, sizeof(path), src, w, h))
+        return 0;
+    memset(&hdr, 0, sizeof(hdr));
+    hdr.magic = ICONPIXELS_MAGIC;
+    hdr.version = ICONPIXELS_VERSION;
+    hdr.src_mtime_sec = st->st_mtim.tv_sec;
+    hdr.src_mtime_nsec = st->st_mtim.tv_nsec;
+    hdr.src_size = st->st_size;
+    hdr.w = w;
+    hdr.h = h;
+    hdr.pathlen = strlen(src) + 1;
+
+    strncpy(tmppath, path, MAXICONPATHLEN);
+    if (!mkdirParents(tmppath)) {
+        pixelsFailure("can't create directory for", path);
+        return 0;
+    }
+    if (!pixelsTrimmed) {
+        // once per run: the directory is read entirely
+        pixelsTrimmed = true;
+        *strrchr(tmppath, '/') = '\0';
+        trimIconPixels(tmppath);
+    }
+    if (snprintf(tmppath, MAXICONPATHLEN, "%s.XXXXXX", path) >=
+        MAXICONPATHLEN)
+        return 0;
+    if ((fd = mkstemp(tmppath)) == -1) {
+        pixelsFailure("can't create", tmppath);
+        return 0;
+    }
+    if (write(fd, &hdr, sizeof(hdr)) != sizeof(hdr)
+        || write(fd, src, hdr.pathlen) != hdr.pathlen
+        || write(fd, buf, npix * sizeof(uint32_t)) != npix * sizeof(uint32_t)) {
+        pixelsFailure("can't write", tmppath);
+        close(fd);
+        unlink(tmppath);
+        return 0;
+    }
+    if (close(fd) != 0 || rename(tmppath, path) == -1) {
+        pixelsFailure("can't save", path);
+        unlink(tmppath);
+        return 0;
+    }
+    msg(1, "pixels of %s cached in %s\n", src, path);
+    return 1;
+}
+
+//
+// scan icon dirs and write user's or system-wide index,
+// without X connection (-mkindex)
+// 1=success
+//
+int buildIconIndex(bool system)
+{
+    char path[MAXICONPATHLEN];
+    icondirlist_t dl = { NULL, 0, 0 };
+    int ret;
+
+    if (!iconIndexPath(path, sizeof(path), system)) {
+        msg(-1, "can't figure out icon index location\n");
+        return 0;
+    }
+    g.ic = NULL;
+    if (!updateIconsFromFile(&g.ic, &dl)) {
+        msg(-1, "can't scan icon directories\n");
+        freeIconDirList(&dl);
+        return 0;
+    }
+    ret = saveIconIndex(g.ic, &dl, path);
+    if (ret)
+        msg(0, "%d icons indexed in %s\n", HASH_COUNT(g.ic), path);
+    freeIconDirList(&dl);
+    deleteIconHash(&g.ic);
+    return ret;
+}
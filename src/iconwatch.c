@@ -0,0 +1,453 @@
+/*
+Icon directory watch: keeps icon hash current while alttab runs.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "config.h"
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <dirent.h>
+#ifdef HAVE_SYS_INOTIFY_H
+#include <sys/inotify.h>
+#endif
+#include "alttab.h"
+#include "icon.h"
+extern Globals g;
+extern Display *dpy;
+
+#ifdef HAVE_SYS_INOTIFY_H
+
+// PRIVATE
+
+// Watched are the roots from allocIconDirs(),
+// their <size> subdirectories and <size>/apps below,
+// that is, directories where inspectIconMeta accepts icons,
+// and their parents, to notice new ones.
+
+#define ICONWATCH_ROOT  0       // theme root
+#define ICONWATCH_SIZE  1       // WxH in theme root
+#define ICONWATCH_APPS  2       // WxH/apps or legacy pixmaps dir: icons are here
+
+#define ICONWATCH_MASK  (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO | \
+                         IN_DELETE | IN_MOVED_FROM | IN_ONLYDIR)
+
+// the same dir may be reached at several levels,
+// e.g. by symlink, so both are the key
+typedef struct {
+    int wd;
+    int level;
+} iconwatchkey_t;
+
+typedef struct {
+    iconwatchkey_t key;         // uthash key
+    char path[MAXICONPATHLEN];
+    UT_hash_handle hh;
+} iconwatch_t;
+
+static int inofd = -1;
+static iconwatch_t *watches = NULL;
+
+//
+// watch of directory at level, or NULL
+//
+static iconwatch_t *findWatch(int wd, int level)
+{
+    iconwatchkey_t key;
+    iconwatch_t *w;
+
+    memset(&key, 0, sizeof(key));
+    key.wd = wd;
+    key.level = level;
+    HASH_FIND(hh, watches, &key, sizeof(iconwatchkey_t), w);
+    return w;
+}
+
+//
+// add directory to inotify
+// return watch or NULL
+//
+static iconwatch_t *addWatch(char *path, int level)
+{
+    iconwatch_t *w;
+    int wd;
+
+    wd = inotify_add_watch(inofd, path, ICONWATCH_MASK);
+    if (wd < 0) {
+        // absent apps dirs and plain files are usual
+        if (errno != ENOENT && errno != ENOTDIR)
+            msg(0, "can't watch %s: %s\n", path, strerror(errno));
+        return NULL;
+    }
+    w = findWatch(wd, level);
+    if (w != NULL)
+        return w;               // the same dir by another path
+    w = malloc(sizeof(iconwatch_t));
+    if (w == NULL)
+        return NULL;
+    memset(w, 0, sizeof(iconwatch_t));
+    w->key.wd = wd;
+    w->key.level = level;
+    strncpy(w->path, path, MAXICONPATHLEN - 1);
+    w->path[MAXICONPATHLEN - 1] = '\0';
+    HASH_ADD(hh, watches, key, sizeof(iconwatchkey_t), w);
+    msg(1, "watching icon dir %s\n", path);
+    return w;
+}
+
+//
+// forget pixmap of the icon, it's loaded again on demand
+//
+static void dropIconContent(icon_t * ic)
+{
+    if (ic->drawable_allocated)
+        XFreePixmap(dpy, ic->drawable);
+    if (ic->mask != None)
+        XFreePixmap(dpy, ic->mask);
+    ic->drawable = ic->mask = None;
+    ic->drawable_allocated = false;
+    ic->drawable_w = ic->drawable_h = 0;
+}
+
+//
+// new or rewritten file: let inspectIconMeta logic decide
+//
+static void applyIconFile(icon_t ** ihash, char *path)
+{
+    icon_t *ic;
+
+    if (inspectIconPath(ihash, path, &ic) && ic != NULL) {
+        msg(0, "icon for %s: %s\n", ic->app, path);
+        dropIconContent(ic);
+    }
+}
+
+//
+// look for the best remaining icon of app in watched dirs
+//
+static void rescanApp(icon_t ** ihash, const char *app)
+{
+    iconwatch_t *w, *tmp;
+    DIR *d;
+    struct dirent *de;
+    char path[MAXICONPATHLEN];
+    size_t applen = strlen(app);
+
+    HASH_ITER(hh, watches, w, tmp) {
+        if (w->key.level != ICONWATCH_APPS)
+            continue;
+        if ((d = opendir(w->path)) == NULL)
+            continue;
+        // app name is a prefix of its icon file name
+        while ((de = readdir(d)) != NULL) {
+            if (strncasecmp(de->d_name, app, applen) != 0)
+                continue;
+            snprintf(path, sizeof(path), "%s/%s", w->path, de->d_name);
+            applyIconFile(ihash, path);
+        }
+        closedir(d);
+    }
+}
+
+//
+// file or directory is gone: drop its files from icons.
+// icons without files left are dropped, and replacements are looked for
+//
+static void forgetIcons(icon_t ** ihash, char *path, bool dir)
+{
+    icon_t *ic, *tmp;
+    const char **apps = NULL;   // interned, so they outlive ic
+    void *na;
+    int napps = 0, size = 0, a;
+
+    HASH_ITER(hh, *ihash, ic, tmp) {
+        if (dropIconSizes(ic, path, dir) == 0)
+            continue;
+        // drawable may come from the dropped file
+        dropIconContent(ic);
+        if (ic->nsizes > 0) {
+            msg(0, "icon for %s: %s/%s\n", ic->app, ic->src_dir,
+                ic->src_name);
+            continue;
+        }
+        if (napps == size) {
+            size = size ? size * 2 : 8;
+            na = realloc(apps, size * sizeof(char *));
+            if (na == NULL)
+                break;
+            apps = na;
+        }
+        apps[napps++] = ic->app;
+        HASH_DEL(*ihash, ic);
+        deleteIcon(ic);
+    }
+    for (a = 0; a < napps; a++) {
+        msg(0, "icon for %s is gone: %s\n", apps[a], path);
+        rescanApp(ihash, apps[a]);
+    }
+    free(apps);
+}
+
+//
+// watch WxH/apps and take icons from it
+//
+static void watchAppsDir(icon_t ** ihash, char *path)
+{
+    DIR *d;
+    struct dirent *de;
+    char fpath[MAXICONPATHLEN];
+
+    if (addWatch(path, ICONWATCH_APPS) == NULL)
+        return;
+    if ((d = opendir(path)) == NULL)
+        return;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        snprintf(fpath, sizeof(fpath), "%s/%s", path, de->d_name);
+        applyIconFile(ihash, fpath);
+    }
+    closedir(d);
+}
+
+//
+// watch theme root, its WxH and WxH/apps directories.
+// ihash=NULL: don't take icons, they're in hash already
+//
+static void watchRoot(icon_t ** ihash, char *root)
+{
+    DIR *d;
+    struct dirent *de;
+    char path[MAXICONPATHLEN];
+
+    if (addWatch(root, ICONWATCH_ROOT) == NULL)
+        return;
+    if ((d = opendir(root)) == NULL)
+        return;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_name[0] == '.')
+            continue;
+        if (de->d_type != DT_DIR && de->d_type != DT_LNK
+            && de->d_type != DT_UNKNOWN)
+            continue;
+        snprintf(path, sizeof(path), "%s/%s", root, de->d_name);
+        if (addWatch(path, ICONWATCH_SIZE) == NULL)
+            continue;
+        strncat(path, "/apps", sizeof(path) - strlen(path) - 1);
+        if (ihash == NULL)
+            addWatch(path, ICONWATCH_APPS);
+        else
+            watchAppsDir(ihash, path);
+    }
+    closedir(d);
+}
+
+//
+// apply inotify event to ihash, as seen by watch w
+//
+static void handleWatchEvent(icon_t ** ihash, iconwatch_t * w,
+                             struct inotify_event *ev)
+{
+    char path[MAXICONPATHLEN];
+
+    if (ev->mask & IN_IGNORED) {  // directory is gone
+        HASH_DEL(watches, w);
+        free(w);
+        return;
+    }
+    if (ev->len == 0)
+        return;
+    snprintf(path, sizeof(path), "%s/%s", w->path, ev->name);
+
+    if (ev->mask & IN_ISDIR) {
+        if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            forgetIcons(ihash, path, true);
+        } else if (w->key.level == ICONWATCH_ROOT) {
+            if (addWatch(path, ICONWATCH_SIZE) != NULL) {
+                strncat(path, "/apps", sizeof(path) - strlen(path) - 1);
+                watchAppsDir(ihash, path);
+            }
+        } else if (w->key.level == ICONWATCH_SIZE
+                   && strcmp(ev->name, "apps") == 0) {
+            watchAppsDir(ihash, path);
+        }
+        return;
+    }
+
+    if (w->key.level != ICONWATCH_APPS)
+        return;
+    if (ev->mask & (IN_DELETE | IN_MOVED_FROM))
+        forgetIcons(ihash, path, false);
+    else
+        applyIconFile(ihash, path);
+}
+
+//
+// apply single inotify event to ihash,
+// for every level its directory is watched at
+//
+static void handleIconEvent(icon_t ** ihash, struct inotify_event *ev)
+{
+    iconwatch_t *w;
+    int level;
+
+    for (level = ICONWATCH_ROOT; level <= ICONWATCH_APPS; level++) {
+        if ((w = findWatch(ev->wd, level)) != NULL)
+            handleWatchEvent(ihash, w, ev);
+    }
+}
+
+//
+// watch roots from allocIconDirs and directories below them.
+// watches which exist already are kept.
+// 1=success
+//
+static int watchIconDirs(void)
+{
+    char *icon_dirs[MAXICONDIRS];
+    int i;
+
+    if (allocIconDirs(icon_dirs) <= 0) {
+        destroyIconDirs(icon_dirs);
+        return 0;
+    }
+    for (i = 0; icon_dirs[i] != NULL; i++) {
+        if (strstr(icon_dirs[i], "pixmap") != NULL)
+            addWatch(icon_dirs[i], ICONWATCH_APPS);
+        else
+            watchRoot(NULL, icon_dirs[i]);
+    }
+    destroyIconDirs(icon_dirs);
+    return 1;
+}
+
+// PUBLIC
+
+//
+// start watching icon directories.
+// changes are queued until processIconWatch.
+// 1=success
+//
+int initIconWatch(void)
+{
+    if (inofd >= 0)
+        return 1;
+    inofd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inofd < 0) {
+        msg(-1, "can't watch icon dirs: %s\n", strerror(errno));
+        return 0;
+    }
+    if (!watchIconDirs())
+        return 0;
+    msg(0, "watching %d icon dirs\n", HASH_COUNT(watches));
+    return 1;
+}
+
+//
+// descriptor to wait for, or -1
+//
+int iconWatchFd(void)
+{
+    return inofd;
+}
+
+//
+// apply queued changes of icon directories to ihash.
+// icons whose file is replaced lose their pixmaps,
+// so it must not be called while they're shown.
+// if events were lost, icon dirs are scanned again in background,
+// and the queue is left for the new hash.
+// return the number of events
+//
+int processIconWatch(icon_t ** ihash)
+{
+    char buf[4096]
+        __attribute__((aligned(__alignof__(struct inotify_event))));
+    struct inotify_event *ev;
+    ssize_t len;
+    char *ptr;
+    int n = 0;
+    bool overflow = false;
+
+    if (inofd < 0)
+        return 0;
+    // non-blocking: stop when the queue is empty
+    while (!overflow && (len = read(inofd, buf, sizeof(buf))) > 0) {
+        for (ptr = buf; ptr < buf + len;
+             ptr += sizeof(struct inotify_event) + ev->len) {
+            ev = (struct inotify_event *)ptr;
+            n++;
+            if (ev->mask & IN_Q_OVERFLOW)
+                overflow = true;
+            else
+                handleIconEvent(ihash, ev);
+        }
+    }
+    if (overflow) {
+        msg(-1, "icon watch queue overflow, rescanning icons\n");
+        // new dirs may be missed too
+        watchIconDirs();
+        rescanIconHash();
+        return n;
+    }
+    if (n > 0)
+        invalidateIconTable();
+    return n;
+}
+
+//
+// stop watching
+//
+void closeIconWatch(void)
+{
+    iconwatch_t *w, *tmp;
+
+    if (inofd < 0)
+        return;
+    HASH_ITER(hh, watches, w, tmp) {
+        HASH_DEL(watches, w);
+        free(w);
+    }
+    close(inofd);
+    inofd = -1;
+}
+
+#else                           /* HAVE_SYS_INOTIFY_H */
+
+// no inotify: icons are refreshed at restart only
+
+int initIconWatch(void)
+{
+    return 0;
+}
+
+int iconWatchFd(void)
+{
+    return -1;
+}
+
+int processIconWatch(icon_t ** ihash)
+{
+    return 0;
+}
+
+void closeIconWatch(void)
+{
+}
+
+#endif                          /* HAVE_SYS_INOTIFY_H */
@@ -280,6 +280,64 @@ int pngReadToDrawable(char *pngpath, Drawable d, uint8_t bg_red,
     return ret;
 }
 
+//
+// decode file into premultiplied ARGB pixels, without X.
+// return malloc'ed w*h array or NULL
+//
+uint32_t *pngReadToARGB(char *pngpath, unsigned int *w, unsigned int *h)
+{
+    FILE *infile;
+    TImage img;
+    uint32_t *argb;
+    uint8_t *src;
+    uint32_t r, g, b, a, row, i;
+
+    img.data = NULL;
+    img.png_ptr = NULL;
+    img.info_ptr = NULL;
+    if (!(infile = fopen(pngpath, "rb"))) {
+        fprintf(stderr, "can't open [%s]\n", pngpath);
+        return NULL;
+    }
+    if ((pngInit(infile, &img)) != 1) {
+        fprintf(stderr, "error reading png header\n");
+        fclose(infile);
+        return NULL;
+    }
+    img.data = pngLoadData(&img);
+    fclose(infile);
+    if (!img.data || img.width == 0 || img.height == 0
+        || (img.channels != 3 && img.channels != 4)) {
+        fprintf(stderr, "error loading png data\n");
+        pngFree(&img);
+        return NULL;
+    }
+    argb = malloc(img.width * img.height * sizeof(uint32_t));
+    if (!argb) {
+        pngFree(&img);
+        return NULL;
+    }
+    for (row = 0; row < img.height; ++row) {
+        src = img.data + row * img.rowbytes;
+        for (i = 0; i < img.width; ++i) {
+            r = *src++;
+            g = *src++;
+            b = *src++;
+            a = (img.channels == 4) ? *src++ : 255;
+            if (a != 255) {
+                r = (r * a + 127) / 255;
+                g = (g * a + 127) / 255;
+                b = (b * a + 127) / 255;
+            }
+            argb[row * img.width + i] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+    }
+    *w = img.width;
+    *h = img.height;
+    pngFree(&img);
+    return argb;
+}
+
 //
 // standalone test for pngReadToDrawable (see test/)
 //
@@ -46,6 +46,7 @@ int pngDraw(TImage * img, Drawable d, XImage * ximage, Visual * visual,
             uint8_t bg_red, uint8_t bg_green, uint8_t bg_blue);
 int pngReadToDrawable(char *pngpath, Drawable d, uint8_t bg_red,
                       uint8_t bg_green, uint8_t bg_blue);
+uint32_t *pngReadToARGB(char *pngpath, unsigned int *w, unsigned int *h);
 int pngReadToDrawable_test(char *pngfile);
 
 #endif
@@ -194,6 +194,35 @@ int execAndReadStdout(char *exe, char *args[], char *buf, int bufsize)
     return 1;
 }
 
+//
+// scaled size and offset of srcW x srcH image
+// centered in dstW x dstH, preserving aspect ratio
+//
+static void fitRect(unsigned int srcW, unsigned int srcH,
+                    unsigned int dstW, unsigned int dstH,
+                    int *dstWscal, int *dstHscal, int *dstWoff, int *dstHoff)
+{
+    int32_t fWrat, fHrat;       // ratio * 65536
+
+    fWrat = (dstW << 16) / srcW;
+    fHrat = (dstH << 16) / srcH;
+    if (fWrat > fHrat) {
+        *dstWscal = ((srcW * fHrat) >> 16);
+        if (abs(*dstWscal - dstW) <= 1)  // suppress rounding errors
+            *dstWscal = dstW;
+        *dstWoff = (dstW - *dstWscal) / 2;
+        *dstHscal = dstH;
+        *dstHoff = 0;
+    } else {
+        *dstWscal = dstW;
+        *dstWoff = 0;
+        *dstHscal = ((srcH * fWrat) >> 16);
+        if (abs(*dstHscal - dstH) <= 1)
+            *dstHscal = dstH;
+        *dstHoff = (dstH - *dstHscal) / 2;
+    }
+}
+
 //
 // Fit the src/src_mask drawable into dst,
 // centering and preserving aspect ratio
@@ -323,27 +352,10 @@ int pixmapFit(Drawable src, Pixmap src_mask, Drawable dst,
               unsigned int dstW, unsigned int dstH)
 {
     int event_basep, error_basep;
-    int32_t fWrat, fHrat;       // ratio * 65536
     int dstWscal, dstWoff, dstHscal, dstHoff;
 
-    fWrat = (dstW << 16) / srcW;
-    fHrat = (dstH << 16) / srcH;
-    if (fWrat > fHrat) {
-        dstWscal = ((srcW * fHrat) >> 16);
-        if (abs(dstWscal - dstW) <= 1)  // suppress rounding errors
-            dstWscal = dstW;
-        dstWoff = (dstW - dstWscal) / 2;
-        dstHscal = dstH;
-        dstHoff = 0;
-    } else {
-        dstWscal = dstW;
-        dstWoff = 0;
-        dstHscal = ((srcH * fWrat) >> 16);
-        if (abs(dstHscal - dstH) <= 1)
-            dstHscal = dstH;
-        dstHoff = (dstH - dstHscal) / 2;
-    }
-
+    fitRect(srcW, srcH, dstW, dstH,
+            &dstWscal, &dstHscal, &dstWoff, &dstHoff);
     return XRenderQueryExtension(dpy, &event_basep, &error_basep) == True ?
         pixmapFitXrender(src, src_mask, dst, srcW, srcH,
                          dstWscal, dstHscal, dstWoff,
@@ -353,6 +365,54 @@ int pixmapFit(Drawable src, Pixmap src_mask, Drawable dst,
                                                      dstHoff);
 }
 
+//
+// Fit premultiplied ARGB image src into dst, like pixmapFit,
+// but on client side, averaging source pixels (box filter).
+// dst is cleared, so margins are transparent.
+// 1=success 0=fail
+//
+int argbFit(uint32_t * src, unsigned int srcW, unsigned int srcH,
+            uint32_t * dst, unsigned int dstW, unsigned int dstH)
+{
+    int dstWscal, dstWoff, dstHscal, dstHoff;
+    unsigned int x, y, sx, sy, sx0, sx1, sy0, sy1, n;
+    uint32_t a, r, gr, b, p;
+
+    if (srcW == 0 || srcH == 0 || dstW == 0 || dstH == 0)
+        return 0;
+    fitRect(srcW, srcH, dstW, dstH,
+            &dstWscal, &dstHscal, &dstWoff, &dstHoff);
+    if (dstWscal <= 0 || dstHscal <= 0)
+        return 0;
+    memset(dst, 0, dstW * dstH * sizeof(uint32_t));
+    for (y = 0; y < dstHscal; y++) {
+        sy0 = y * srcH / dstHscal;
+        sy1 = (y + 1) * srcH / dstHscal;
+        if (sy1 <= sy0)
+            sy1 = sy0 + 1;
+        for (x = 0; x < dstWscal; x++) {
+            sx0 = x * srcW / dstWscal;
+            sx1 = (x + 1) * srcW / dstWscal;
+            if (sx1 <= sx0)
+                sx1 = sx0 + 1;
+            a = r = gr = b = n = 0;
+            for (sy = sy0; sy < sy1; sy++) {
+                for (sx = sx0; sx < sx1; sx++) {
+                    p = src[sy * srcW + sx];
+                    a += p >> 24;
+                    r += (p >> 16) & 0xff;
+                    gr += (p >> 8) & 0xff;
+                    b += p & 0xff;
+                    n++;
+                }
+            }
+            dst[(y + dstHoff) * dstW + x + dstWoff] =
+                ((a / n) << 24) | ((r / n) << 16) | ((gr / n) << 8) | (b / n);
+        }
+    }
+    return 1;
+}
+
 //
 // Return the number of utf8 code points in the buffer at s
 //
@@ -581,7 +641,7 @@ Bool predproc_true(Display * display, XEvent * event, char *arg)
 // obtain X Window property
 // prop_size is returned in bytes
 //
-char *get_x_property(Window win, Atom prop_type, char *prop_name,
+char *get_x_property(Window win, Atom prop_type, Atom prop,
                      unsigned long *prop_size)
 {
 
@@ -589,26 +649,24 @@ char *get_x_property(Window win, Atom prop_type, char *prop_name,
     unsigned long n_prop_ret_items, ret_bytes_after, size;
     unsigned char *ret_prop;
     char *r;
-    Atom prop_name_x, prop_ret_type_x;
-    int max_prop_len;
+    Atom prop_ret_type_x;
+    bool prefetched;
 
     int debug = 0;
 
-    prop_name_x = XInternAtom(dpy, prop_name, False);
-    max_prop_len = strstr(prop_name, "ICON") == NULL ? MAXPROPLEN : MAXPROPBIG;
-
-    ee_complain = false;
-    Status propstatus =
-        XGetWindowProperty(dpy, win, prop_name_x, 0, max_prop_len / 4, False,
-                           prop_type, &prop_ret_type_x, &prop_ret_fmt,
-                           &n_prop_ret_items, &ret_bytes_after, &ret_prop);
-    XSync(dpy, False);          // for error to "appear"
-    ee_complain = true;
-
-    if (propstatus != Success && debug > 0) {
-        fprintf(stderr,
-                "get_x_property: XGetWindowProperty failed (win %ld, prop %s)\n",
-                win, prop_name);
+    // already received in a batch?
+    prefetched = prefetched_x_property(win, prop, &prop_ret_type_x,
+                                       &prop_ret_fmt, &n_prop_ret_items,
+                                       &ret_prop);
+    if (!prefetched
+        && !checked_x_property(win, prop, prop_type, 0,
+                               MAXPROPLEN / 4, &prop_ret_type_x,
+                               &prop_ret_fmt, &n_prop_ret_items,
+                               &ret_bytes_after, &ret_prop)) {
+        if (debug > 0)
+            fprintf(stderr,
+                    "get_x_property: XGetWindowProperty failed (win %ld, prop %lu)\n",
+                    win, prop);
         return (char *)NULL;
     }
 
@@ -616,13 +674,14 @@ char *get_x_property(Window win, Atom prop_type, char *prop_name,
         // this diagnostic may cause BadAtom
         if (debug > 1)
             fprintf(stderr,
-                    "get_x_property: prop type doesn't match (win %ld, prop %s, requested: %s, obtained: %s)\n",
-                    win, prop_name,
+                    "get_x_property: prop type doesn't match (win %ld, prop %lu, requested: %s, obtained: %s)\n",
+                    win, prop,
                     (prop_type == 0) ? "0" : XGetAtomName(dpy,
                                                           prop_type),
                     (prop_ret_type_x == 0) ? "0" : XGetAtomName(dpy,
                                                                 prop_ret_type_x));
-        XFree(ret_prop);
+        if (!prefetched)
+            free(ret_prop);
         return (char *)NULL;
     }
 
@@ -637,25 +696,60 @@ char *get_x_property(Window win, Atom prop_type, char *prop_name,
         *prop_size = size;
     }
 
-    XFree(ret_prop);
+    if (!prefetched)
+        free(ret_prop);
     return r;
 }
 
 char *get_x_property_alt(Window win,
-			 Atom prop_type1, char *prop_name1,
-			 Atom prop_type2, char *prop_name2,
+			 Atom prop_type1, Atom prop1,
+			 Atom prop_type2, Atom prop2,
 			 unsigned long *prop_size)
 {
     char *p;
 
-    p = get_x_property(win, prop_type1, prop_name1, prop_size);
+    p = get_x_property(win, prop_type1, prop1, prop_size);
     if (p != NULL)
         return p;
 
-    p = get_x_property(win, prop_type2, prop_name2, prop_size);
+    p = get_x_property(win, prop_type2, prop2, prop_size);
     return p;
 }
 
+//
+// obtain part of 32-bit X Window property:
+// length items from offset, both in 32-bit units.
+// *nitems gets the number of items obtained,
+// *total the length of the whole property.
+// items are returned as longs, like Xlib does
+//
+long *get_x_property_range(Window win, Atom prop_type, Atom prop,
+                           long offset, long length,
+                           unsigned long *nitems, unsigned long *total)
+{
+    int prop_ret_fmt;
+    unsigned long n_prop_ret_items, ret_bytes_after;
+    unsigned char *ret_prop;
+    Atom prop_ret_type_x;
+    long *r;
+
+    if (!checked_x_property(win, prop, prop_type, offset, length,
+                            &prop_ret_type_x, &prop_ret_fmt,
+                            &n_prop_ret_items, &ret_bytes_after, &ret_prop))
+        return NULL;
+    if (prop_ret_type_x != prop_type || prop_ret_fmt != 32) {
+        free(ret_prop);
+        return NULL;
+    }
+    r = malloc(n_prop_ret_items * sizeof(long) + 1);
+    if (r != NULL)
+        memcpy(r, ret_prop, n_prop_ret_items * sizeof(long));
+    *nitems = n_prop_ret_items;
+    *total = offset + n_prop_ret_items + ret_bytes_after / 4;
+    free(ret_prop);
+    return r;
+}
+
 //
 // do rectangles cross?
 //
@@ -670,17 +764,18 @@ bool rectangles_cross(quad a, quad b)
 //
 bool get_absolute_coordinates(Window w, quad * q)
 {
-    Window child;
-    XWindowAttributes wa;
-    int x, y;
+    Window child, r;
+    int x, y, rx, ry;
+    unsigned int width, height, bw, depth;
     if (XTranslateCoordinates(dpy, w, root, 0, 0, &x, &y, &child) == False)
         return false;
-    if (XGetWindowAttributes(dpy, w, &wa) == 0)
+    // XGetWindowAttributes would ask GetGeometry too
+    if (XGetGeometry(dpy, w, &r, &rx, &ry, &width, &height, &bw, &depth) == 0)
         return false;
     q->x = x;
     q->y = y;
-    q->w = wa.width;
-    q->h = wa.height;
+    q->w = width;
+    q->h = height;
     return true;
 }
 
@@ -843,6 +938,27 @@ CompositeConst initCompositeConst(unsigned long bg)
     return cc;
 }
 
+//
+// compose premultiplied ARGB pixel with background (from "cc")
+//
+uint32_t pixelCompositePremul(uint32_t argb, CompositeConst * cc)
+{
+    uint8_t a = argb >> 24;
+    uint32_t r, g, b;
+
+    if (a == 0)
+        return cc->bg;
+    r = (argb >> 16) & 0xff;
+    g = (argb >> 8) & 0xff;
+    b = argb & 0xff;
+    if (a != 255) {
+        r += (cc->bg_r * (255 - a) + 127) / 255;
+        g += (cc->bg_g * (255 - a) + 127) / 255;
+        b += (cc->bg_b * (255 - a) + 127) / 255;
+    }
+    return (r << cc->RShift) | (g << cc->GShift) | (b << cc->BShift);
+}
+
 //
 // compose "fg" pixel with background (from "cc") using alpha "a"
 //
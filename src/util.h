@@ -33,7 +33,6 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdint.h>
 
 #define MAXPROPLEN  4096
-#define MAXPROPBIG  128000 * sizeof(long)  // for icon array, for example
 #define ERRLEN      2048
 
 #ifndef COMTYPES
@@ -84,6 +83,8 @@ int pixmapFitXrender(Drawable src, Pixmap src_mask, Drawable dst,
                      unsigned int dstWoffset, unsigned int dstHoffset);
 int pixmapFit(Drawable src, Pixmap src_mask, Drawable dst, unsigned int srcW,
               unsigned int srcH, unsigned int dstW, unsigned int dstH);
+int argbFit(uint32_t * src, unsigned int srcW, unsigned int srcH,
+            uint32_t * dst, unsigned int dstW, unsigned int dstH);
 
 size_t utf8len(char *s);
 char *utf8index(char *s, size_t pos);
@@ -98,12 +99,30 @@ int drawSingleLine(Drawable d, XftFont * font, XftColor * xftcolor, char *str,
 
 Bool predproc_true(Display * display, XEvent * event, char *arg);
 
-char *get_x_property(Window win, Atom prop_type, char *prop_name,
+char *get_x_property(Window win, Atom prop_type, Atom prop,
                      unsigned long *prop_size);
 char *get_x_property_alt(Window win,
-			 Atom prop_type1, char *prop_name1,
-			 Atom prop_type2, char *prop_name2,
+			 Atom prop_type1, Atom prop1,
+			 Atom prop_type2, Atom prop2,
 			 unsigned long *prop_size);
+long *get_x_property_range(Window win, Atom prop_type, Atom prop,
+                           long offset, long length,
+                           unsigned long *nitems, unsigned long *total);
+
+// xcbprop.c
+int prefetchProperties(Window * wins, int nwins, Atom * props, int nprops);
+bool prefetched_x_property(Window win, Atom prop, Atom * type, int *format,
+                           unsigned long *nitems, unsigned char **data);
+void dropPrefetchedProperties(void);
+void watchProperties(Window w);
+bool watchingProperties(Window w);
+void forgetProperty(Window w, Atom prop);
+void forgetWindowProperties(Window w);
+void shutdownProperties(void);
+bool checked_x_property(Window win, Atom prop, Atom type,
+                        long offset, long length, Atom * ret_type,
+                        int *format, unsigned long *nitems,
+                        unsigned long *bytes_after, unsigned char **data);
 
 bool rectangles_cross(quad a, quad b);
 bool get_absolute_coordinates(Window w, quad * q);
@@ -119,5 +138,6 @@ unsigned int keycode_to_modmask(KeyCode kc);
 int convert_msb(uint32_t in);
 CompositeConst initCompositeConst(unsigned long bg);
 uint32_t pixelComposite(uint32_t fg, uint8_t a, CompositeConst *cc);
+uint32_t pixelCompositePremul(uint32_t argb, CompositeConst * cc);
 
 #endif
@@ -28,9 +28,11 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <unistd.h>
 #include <string.h>
 #include <utlist.h>
+#include <uthash.h>
 //#include <sys/time.h>
 #include "alttab.h"
 #include "util.h"
@@ -41,67 +43,259 @@ extern Window root;
 
 // PRIVATE
 
+//
+// does window have _NET_WM_STATE_HIDDEN.
+// read from the batch of sortWinlist when called from there
+//
 bool is_minimized(Window win) {
-    Atom netWmState = XInternAtom(dpy, "_NET_WM_STATE", False);
-    Atom hidden = XInternAtom(dpy, "_NET_WM_STATE_HIDDEN", False);
-    if (netWmState == None || hidden == None)
+    Atom *state;
+    unsigned long size, i;
+    bool r = false;
+
+    state = (Atom *) get_x_property(win, XA_ATOM, g.atom[AT_NET_WM_STATE],
+                                    &size);
+    if (state == NULL)
         return false;
+    for (i = 0; i < size / sizeof(Atom); i++) {
+        if (state[i] == g.atom[AT_NET_WM_STATE_HIDDEN]) {
+            r = true;
+            break;
+        }
+    }
+    free(state);
+    return r;
+}
+
+// window whose file icon is loaded during idle, see warmupIcons
+typedef struct WarmupWindow {
+    Window id;                  // uthash key
+    struct WarmupWindow *prev, *next;   // utlist, oldest first
+    UT_hash_handle hh;
+} WarmupWindow;
+static WarmupWindow *warmq = NULL, *warmidx = NULL;
+
+// pixmap made from icon in X, shared by windows with the same icon
+typedef struct {
+    uint64_t sum;               // checksum of _NET_WM_ICON image or id of WM_HINTS pixmap
+    unsigned int w, h;
+    bool hints;                 // sum is WM_HINTS pixmap id
+} SharedIconKey;
+typedef struct SharedIcon {
+    SharedIconKey key;          // uthash key in shicons
+    Pixmap pixmap;              // uthash key in shicons_pix
+    int refs;
+    bool unshared;              // removed from shicons, see unshareHintsIcon
+    UT_hash_handle hh, hhp;
+} SharedIcon;
+static SharedIcon *shicons = NULL, *shicons_pix = NULL;
+
+// icon source decisions by WM_CLASS, see ClassIcon
+static ClassIcon *classicons = NULL;
+
+// g.sortlist elements by window id
+static PermanentWindowInfo *sortidx = NULL;
+// free sortlist elements, linked by next, and memory they come from
+#define SORTPOOL_CHUNK  64
+static PermanentWindowInfo *sortpool = NULL;
+static PermanentWindowInfo **sortchunks = NULL;
+static int nsortchunks = 0;
+
+// absolute geometry of windows for -sc 0, see winGeometry
+#define GEOM_MAXANC  4
+typedef struct {
+    Window id;                  // uthash key
+    Window frame;               // child of root which contains the window
+    Window anc[GEOM_MAXANC];    // windows between frame and window
+    int nanc;
+    int fx, fy;                 // absolute position of frame
+    quad q;                     // absolute geometry of window
+    UT_hash_handle hh;
+} WindowGeometry;
+static WindowGeometry *geomidx = NULL;
 
-    Atom type;
-    int format;
-    unsigned long n, leftover;
-    Atom *atoms = NULL;
+//
+// find child of root which contains wg->id,
+// and windows between them.
+// return false if window is gone or nested too deep
+//
+static bool geomAncestors(WindowGeometry * wg)
+{
+    Window w, r, parent, *children;
+    unsigned int nchildren;
+
+    wg->nanc = 0;
+    for (w = wg->id; w != root; w = parent) {
+        if (XQueryTree(dpy, w, &r, &parent, &children, &nchildren) == 0)
+            return false;
+        if (children)
+            XFree(children);
+        if (parent == root) {
+            wg->frame = w;
+            return true;
+        }
+        if (w != wg->id) {
+            if (wg->nanc == GEOM_MAXANC)
+                return false;
+            wg->anc[wg->nanc++] = w;
+        }
+    }
+    return false;
+}
 
-    if (XGetWindowProperty(dpy, win, netWmState, 0, 8, False, XA_ATOM,
-                           &type, &format, &n, &leftover,
-                           (unsigned char**)&atoms) != Success || !atoms)
+//
+// absolute geometry of window w.
+// asked from X only once, then kept by ConfigureNotify
+// of the window, of its frame and of windows between them,
+// see winConfigureEvent
+//
+static bool winGeometry(Window w, quad * q)
+{
+    WindowGeometry *wg;
+    quad fq;
+    int i;
+
+    HASH_FIND(hh, geomidx, &w, sizeof(Window), wg);
+    if (wg != NULL) {
+        *q = wg->q;
+        return true;
+    }
+    wg = malloc(sizeof(WindowGeometry));
+    if (wg == NULL)
+        return get_absolute_coordinates(w, q);
+    memset(wg, 0, sizeof(WindowGeometry));
+    wg->id = w;
+    if (!geomAncestors(wg)) {
+        free(wg);
+        return get_absolute_coordinates(w, q);
+    }
+    if (!get_absolute_coordinates(w, &(wg->q))
+        || (wg->frame != w && !get_absolute_coordinates(wg->frame, &fq))) {
+        free(wg);
         return false;
+    }
+    if (wg->frame == w)
+        fq = wg->q;
+    wg->fx = fq.x;
+    wg->fy = fq.y;
+    // for ConfigureNotify and DestroyNotify of the window.
+    // those of frame come to root, see startupWintasks
+    x_setCommonPropertiesForAnyWindow(w);
+    // windows between move the window inside the frame
+    for (i = 0; i < wg->nanc; i++)
+        x_addEventMask(wg->anc[i], StructureNotifyMask);
+    HASH_ADD(hh, geomidx, id, sizeof(Window), wg);
+    *q = wg->q;
+    return true;
+}
 
-    for (unsigned long i = 0; i < n; i++) {
-        if (atoms[i] == hidden) {
-            XFree(atoms);
-            return true;
+//
+// forget geometry of window, and of windows in it
+// if it is a frame or between a frame and a window
+//
+static void forgetGeometry(Window w)
+{
+    WindowGeometry *wg, *tmp;
+    int i;
+
+    HASH_ITER(hh, geomidx, wg, tmp) {
+        for (i = 0; i < wg->nanc && wg->anc[i] != w; i++) ;
+        if (wg->id == w || wg->frame == w || i < wg->nanc) {
+            HASH_DEL(geomidx, wg);
+            free(wg);
         }
     }
+}
 
-    XFree(atoms);
-    return false;
+//
+// take sortlist element from the pool
+//
+static PermanentWindowInfo *sortNodeAlloc(void)
+{
+    PermanentWindowInfo *chunk, **nc, *s;
+    int i;
+
+    if (sortpool == NULL) {
+        nc = realloc(sortchunks, (nsortchunks + 1) * sizeof(*sortchunks));
+        if (nc == NULL)
+            return NULL;
+        sortchunks = nc;
+        chunk = malloc(SORTPOOL_CHUNK * sizeof(PermanentWindowInfo));
+        if (chunk == NULL)
+            return NULL;
+        sortchunks[nsortchunks++] = chunk;
+        for (i = 0; i < SORTPOOL_CHUNK; i++) {
+            chunk[i].next = sortpool;
+            sortpool = &chunk[i];
+        }
+    }
+    s = sortpool;
+    sortpool = s->next;
+    memset(s, 0, sizeof(PermanentWindowInfo));
+    return s;
 }
 
+//
+// unlink sortlist element and return it to the pool
+//
+static void removeFromSortlist(PermanentWindowInfo * s)
+{
+    HASH_DEL(sortidx, s);
+    DL_DELETE(g.sortlist, s);
+    s->next = sortpool;
+    sortpool = s;
+}
 
 //
-// helper for windows' qsort
-// CAUSES O(log(N)) OR EVEN WORSE! reintroduce winlist[]->order instead?
+// helper for windows' qsort.
+// keys are precomputed by sortWinlist
 //
 static int sort_by_order(const void *p1, const void *p2)
 {
-    PermanentWindowInfo *s;
     WindowInfo *w1 = (WindowInfo *) p1;
     WindowInfo *w2 = (WindowInfo *) p2;
-    int r = 0;
 
-    DL_FOREACH(g.sortlist, s) {
-        if (g.option_sort_minimize) {
-            bool w1_min = is_minimized(w1->id);
-            bool w2_min = is_minimized(w2->id);
+    if (w1->minimized != w2->minimized)
+        return w1->minimized ? 1 : -1;
+    return (w1->order > w2->order) - (w1->order < w2->order);
+}
 
-            if (w1_min != w2_min) {
-                r = (w1_min) ? 1 : -1;
-                break;
-            }
-        }
+//
+// sort winlist according to sortlist,
+// minimized windows last if option_sort_minimize.
+// sortlist is walked and _NET_WM_STATE is read once per window,
+// not per comparison
+//
+static void sortWinlist(void)
+{
+    PermanentWindowInfo *s;
+    Window *ids;
+    int i;
 
-        if (s->id == w1->id) {
-            r = (s->id == w2->id) ? 0 : -1;
-            break;
-        }
-        if (s->id == w2->id) {
-            r = 1;
-            break;
+    i = 0;
+    DL_FOREACH(g.sortlist, s) {
+        s->rank = i++;
+    }
+    for (i = 0; i < g.maxNdx; i++) {
+        HASH_FIND(hh, sortidx, &(g.winlist[i].id), sizeof(Window), s);
+        // not in sortlist: after all that are
+        g.winlist[i].order = s ? s->rank : INT_MAX;
+        g.winlist[i].minimized = false;
+    }
+
+    if (g.option_sort_minimize && g.maxNdx > 0) {
+        ids = malloc(g.maxNdx * sizeof(Window));
+        if (ids != NULL) {
+            for (i = 0; i < g.maxNdx; i++)
+                ids[i] = g.winlist[i].id;
+            // windows of WM-specific batch aren't requested again
+            prefetchProperties(ids, g.maxNdx, &(g.atom[AT_NET_WM_STATE]), 1);
+            free(ids);
         }
+        for (i = 0; i < g.maxNdx; i++)
+            g.winlist[i].minimized = is_minimized(g.winlist[i].id);
     }
-    //msg(0, "cmp 0x%lx <-> 0x%lx = %d\n", w1->id, w2->id, r);
-    return r;
+
+    qsort(g.winlist, g.maxNdx, sizeof(WindowInfo), sort_by_order);
 }
 
 //
@@ -140,6 +334,336 @@ static void print_winlist(void)
     }
 }
 
+//
+// FNV-1a of 32-bit ARGB pixels as returned by XGetWindowProperty
+//
+static uint64_t iconChecksum(long *pixels, unsigned long n)
+{
+    uint64_t h = 14695981039346656037ULL;
+    unsigned long i;
+    uint32_t v;
+    int b;
+
+    for (i = 0; i < n; i++) {
+        v = pixels[i];
+        for (b = 0; b < 4; b++) {
+            h ^= (v >> (b * 8)) & 0xff;
+            h *= 1099511628211ULL;
+        }
+    }
+    return h;
+}
+
+//
+// return pixmap already made from icon "k", taking a reference to it,
+// or 0
+//
+static Pixmap findSharedIcon(SharedIconKey * k)
+{
+    SharedIcon *si;
+
+    HASH_FIND(hh, shicons, k, sizeof(SharedIconKey), si);
+    if (si == NULL)
+        return 0;
+    si->refs++;
+    msg(1, "sharing icon pixmap %lx, %d users\n", si->pixmap, si->refs);
+    return si->pixmap;
+}
+
+//
+// remember pixmap just made from icon "k"
+// if it can't be remembered, it's simply not shared
+//
+static void addSharedIcon(SharedIconKey * k, Pixmap p)
+{
+    SharedIcon *si;
+
+    si = malloc(sizeof(SharedIcon));
+    if (si == NULL)
+        return;
+    si->key = *k;
+    si->pixmap = p;
+    si->refs = 1;
+    si->unshared = false;
+    HASH_ADD(hh, shicons, key, sizeof(SharedIconKey), si);
+    HASH_ADD(hhp, shicons_pix, pixmap, sizeof(Pixmap), si);
+}
+
+//
+// counterpair for findSharedIcon/addSharedIcon:
+// free icon pixmap made by us when its last user is gone
+//
+static void releaseIconPixmap(Pixmap p)
+{
+    SharedIcon *si;
+
+    HASH_FIND(hhp, shicons_pix, &p, sizeof(Pixmap), si);
+    if (si != NULL) {
+        if (--(si->refs) > 0)
+            return;
+        if (!si->unshared)
+            HASH_DELETE(hh, shicons, si);
+        HASH_DELETE(hhp, shicons_pix, si);
+        free(si);
+    }
+    XFreePixmap(dpy, p);
+}
+
+//
+// WM_HINTS of a window using icon pixmap "p" changed.
+// if "p" was made from WM_HINTS pixmap, the client may have
+// drawn new icon into the same pixmap id: stop sharing "p",
+// and make all its users fetch the icon again.
+//
+static void unshareHintsIcon(Pixmap p)
+{
+    SharedIcon *si;
+    WindowIcon *c, *tmp;
+
+    HASH_FIND(hhp, shicons_pix, &p, sizeof(Pixmap), si);
+    if (si == NULL || !si->key.hints || si->unshared)
+        return;
+    HASH_DELETE(hh, shicons, si);
+    si->unshared = true;
+    HASH_ITER(hh, g.wicon, c, tmp) {
+        if (c->allocated && c->drawable == p) {
+            c->stale = true;
+            uiForgetTile(c->id);
+        }
+    }
+}
+
+//
+// find out dimensions of wi->icon_drawable
+// and convert it into default depth if needed.
+// on failure, icon_drawable is reset to 0.
+//
+static void setIconGeometry(WindowInfo * wi)
+{
+    Window root_return;
+    int x_return, y_return;
+    unsigned int border_width_return;
+    unsigned int icon_depth = 0;
+
+    if (XGetGeometry(dpy, wi->icon_drawable,
+                     &root_return, &x_return, &y_return,
+                     &(wi->icon_w),
+                     &(wi->icon_h),
+                     &border_width_return, &icon_depth) == 0) {
+        msg(0, "icon dimensions unknown (%s)\n", wi->name);
+        // probably draw placeholder?
+        wi->icon_drawable = 0;
+        return;
+    }
+    msg(1, "depth=%d\n", icon_depth);
+// convert icon with different depth (currently 1 only) into default depth
+    if (icon_depth == 1) {
+        // clients often share one bitmap between their windows
+        SharedIconKey k;
+        memset(&k, 0, sizeof(k));
+        k.sum = wi->icon_drawable;
+        k.w = wi->icon_w;
+        k.h = wi->icon_h;
+        k.hints = true;
+        Pixmap pswap = findSharedIcon(&k);
+        if (!pswap) {
+            msg(0,
+                "rebuilding icon from depth %d to %d (%s)\n",
+                icon_depth, XDEPTH, wi->name);
+            pswap = XCreatePixmap(dpy, wi->icon_drawable,
+                                  wi->icon_w,
+                                  wi->icon_h, XDEPTH);
+            if (!pswap)
+                die("can't create pixmap");
+            // GC should be already prepared in uiShow
+            if (!XCopyPlane
+                (dpy, wi->icon_drawable, pswap, g.gcDirect,
+                 0, 0, wi->icon_w,
+                 wi->icon_h, 0, 0, 1))
+                die("can't copy plane");    // plane #1?
+            addSharedIcon(&k, pswap);
+        }
+        wi->icon_drawable = pswap;
+        wi->icon_allocated = true;  // for subsequent free()
+        icon_depth = XDEPTH;
+    }
+    if (icon_depth != XDEPTH) {
+        msg(-1,
+            "can't handle icon depth other than %d or 1 (%d, %s). Please report this condition.\n",
+            XDEPTH, icon_depth, wi->name);
+        wi->icon_drawable = wi->icon_w =
+            wi->icon_h = 0;
+    }
+}
+
+//
+// free pixmap of the cached window icon, if it's ours
+//
+static void dropWindowIcon(WindowIcon * c)
+{
+    if (c->allocated && c->drawable)
+        releaseIconPixmap(c->drawable);
+    c->drawable = c->mask = 0;
+    c->allocated = false;
+}
+
+//
+// entry of g.wicon for window "w", created on first sight.
+// return NULL if it can't be created
+//
+static WindowIcon *windowIconEntry(Window w)
+{
+    WindowIcon *c;
+
+    HASH_FIND(hh, g.wicon, &w, sizeof(Window), c);
+    if (c != NULL)
+        return c;
+    c = malloc(sizeof(WindowIcon));
+    if (c == NULL)
+        return NULL;
+    c->id = w;
+    c->drawable = c->mask = 0;
+    c->w = c->h = 0;
+    c->allocated = false;
+    c->stale = true;            // nothing fetched yet
+    c->cls = NULL;
+    HASH_ADD(hh, g.wicon, id, sizeof(Window), c);
+    return c;
+}
+
+//
+// icon source decision for WM_CLASS of window "w".
+// WM_CLASS is read once per window if "c" is given.
+// return NULL if window has no WM_CLASS
+//
+static ClassIcon *windowClassIcon(Window w, WindowIcon * c)
+{
+    char *appclass, *s;
+    unsigned long class_size;
+    ClassIcon *ci;
+
+    if (c != NULL && c->cls != NULL)
+        return c->cls;
+    appclass = get_x_property(w, XA_STRING, XA_WM_CLASS, &class_size);
+    if (appclass == NULL)
+        return NULL;
+    // icon names can't contain '/'
+    for (s = appclass; s - appclass < class_size; s++)
+        if (*s == '/')
+            *s = '_';
+    HASH_FIND(hh, classicons, appclass, class_size, ci);
+    if (ci != NULL) {
+        free(appclass);
+    } else {
+        ci = malloc(sizeof(ClassIcon));
+        if (ci == NULL) {
+            free(appclass);
+            return NULL;
+        }
+        ci->wmclass = appclass;
+        ci->size = class_size;
+        ci->nofile = false;
+        ci->file_wins = false;
+        HASH_ADD_KEYPTR(hh, classicons, ci->wmclass, ci->size, ci);
+    }
+    if (c != NULL)
+        c->cls = ci;
+    return ci;
+}
+
+//
+// file icon for application class "ci", with content loaded.
+// if "wi" is given, the icon must also suit its size options
+// (see addIconFromFiles), otherwise the first found is taken.
+// a class without file icon is remembered until icon hash changes.
+// return NULL if not found
+//
+static icon_t *classFileIcon(ClassIcon * ci, WindowInfo * wi)
+{
+    char *tryclass;
+    icon_t *ic;
+    bool found = false;
+
+    if (ci->nofile && ci->nofile_gen == iconHashGeneration()) {
+        msg(1, "no file icon for class %s (cached)\n", ci->wmclass);
+        return NULL;
+    }
+    for (tryclass = ci->wmclass; tryclass - ci->wmclass < ci->size;
+         tryclass += (strlen(tryclass) + 1)) {
+        ic = lookupIcon(tryclass);
+        if (ic == NULL)
+            continue;
+        found = true;
+        if (wi == NULL
+             || (g.option_iconSrc != ISRC_SIZE
+                    && g.option_iconSrc != ISRC_SIZE2)
+             || (g.option_iconSrc == ISRC_SIZE
+                    && iconMatchBetter(
+                                ic->src_w, ic->src_h,
+                                wi->icon_w, wi->icon_h,
+                                false))
+             || (g.option_iconSrc == ISRC_SIZE2
+                    && iconMatchBetter(
+                                ic->src_w, ic->src_h,
+                                wi->icon_w, wi->icon_h,
+                                true))
+            ) {
+            if (ic->drawable == None) {
+                msg(1, "loading content for %s\n", ic->app);
+                if (loadIconContent(ic) == 0) {
+                    msg(-1, "can't load file icon content: %s/%s\n",
+                        ic->src_dir, ic->src_name);
+                    continue;
+                }
+            }
+            return ic;
+        }
+    }
+    if (!found) {
+        ci->nofile = true;
+        ci->nofile_gen = iconHashGeneration();
+    }
+    return NULL;
+}
+
+//
+// search for icon in NET_WM_ICON, then in WM hints of "wi".
+// the result, including "no icon", is kept in "c" (element of g.wicon),
+// so that next uiShow doesn't fetch and composite it again
+// until winPropChangeEvent marks it stale.
+// return 1 if icon found, 0 otherwise.
+//
+static int addIconFromX(WindowInfo * wi, WindowIcon * c)
+{
+    if (c != NULL && !c->stale) {
+        msg(1, "cached icon for %lx\n", wi->id);
+        wi->icon_drawable = c->drawable;
+        wi->icon_mask = c->mask;
+        wi->icon_w = c->w;
+        wi->icon_h = c->h;
+#ifdef ICON_DEBUG
+        strcpy(wi->icon_src, c->src);
+#endif
+        return c->drawable ? 1 : 0;
+    }
+    if (addIconFromProperty(wi) || addIconFromHints(wi))
+        setIconGeometry(wi);
+    if (c == NULL)
+        return wi->icon_drawable ? 1 : 0;   // freeWinlist releases it
+    dropWindowIcon(c);
+    c->drawable = wi->icon_drawable;
+    c->mask = wi->icon_mask;
+    c->w = wi->icon_w;
+    c->h = wi->icon_h;
+    c->allocated = wi->icon_allocated;
+    c->stale = false;
+#ifdef ICON_DEBUG
+    strcpy(c->src, wi->icon_src);
+#endif
+    wi->icon_allocated = false; // it's g.wicon's now
+    return c->drawable ? 1 : 0;
+}
+
 // PUBLIC
 
 //
@@ -152,12 +676,13 @@ void addToSortlist(Window w, bool to_head, bool move)
     bool was = false;
     bool add = false;
 
-    DL_SEARCH_SCALAR(g.sortlist, s, id, w);
+    HASH_FIND(hh, sortidx, &w, sizeof(Window), s);
     if (s == NULL) {
-        s = malloc(sizeof(PermanentWindowInfo));
+        s = sortNodeAlloc();
         if (s == NULL)
             return;
         s->id = w;
+        HASH_ADD(hh, sortidx, id, sizeof(Window), s);
         add = true;
     } else {
         was = true;
@@ -177,6 +702,135 @@ void addToSortlist(Window w, bool to_head, bool move)
         // new window
         // register interest in events
         x_setCommonPropertiesForAnyWindow(w);
+        queueIconWarmup(w);
+    }
+}
+
+//
+// window is gone: drop everything kept for it,
+// except of sortlist element
+//
+static void forgetWindow(Window w)
+{
+    WindowIcon *c;
+
+    forgetWindowProperties(w);
+    forgetGeometry(w);
+    HASH_FIND(hh, g.wicon, &w, sizeof(Window), c);
+    if (c != NULL) {
+        HASH_DEL(g.wicon, c);
+        dropWindowIcon(c);
+        free(c);
+    }
+    uiForgetTile(w);
+}
+
+//
+// remove windows other than "keep" from sortlist.
+// those are gone without DestroyNotify seen by us,
+// f.e. destroyed before we selected events on them.
+// done only when sortlist outgrows "keep" by SORTLIST_SLACK,
+// so memory stays bounded without a walk on every call
+//
+#define SORTLIST_SLACK  32
+void compactSortlist(Window * keep, int nkeep)
+{
+    PermanentWindowInfo *s, *tmp;
+    int i, removed = 0;
+
+    if (HASH_CNT(hh, sortidx) <= nkeep + SORTLIST_SLACK)
+        return;
+    DL_FOREACH(g.sortlist, s) {
+        s->alive = false;
+    }
+    for (i = 0; i < nkeep; i++) {
+        HASH_FIND(hh, sortidx, &(keep[i]), sizeof(Window), s);
+        if (s != NULL)
+            s->alive = true;
+    }
+    DL_FOREACH_SAFE(g.sortlist, s, tmp) {
+        if (!s->alive) {
+            forgetWindow(s->id);
+            removeFromSortlist(s);
+            removed++;
+        }
+    }
+    msg(1, "compactSortlist: %d windows removed\n", removed);
+}
+
+//
+// remember window to load its file icon during idle.
+// window already in the queue isn't queued again.
+//
+void queueIconWarmup(Window w)
+{
+    WarmupWindow *q;
+
+    if (g.option_iconSrc == ISRC_RAM || g.option_iconSrc == ISRC_NONE)
+        return;
+    HASH_FIND(hh, warmidx, &w, sizeof(Window), q);
+    if (q != NULL)
+        return;
+    q = malloc(sizeof(WarmupWindow));
+    if (q == NULL)
+        return;
+    q->id = w;
+    HASH_ADD(hh, warmidx, id, sizeof(Window), q);
+    DL_APPEND(warmq, q);
+}
+
+//
+// load file icon content for one queued window,
+// so that uiShow finds it ready.
+// called by main loop when there is no X event and icon hash is ready.
+// return 1 if something was done, 0 if queue is empty
+//
+int warmupIcons(void)
+{
+    WarmupWindow *q;
+    WindowIcon *c;
+    ClassIcon *ci;
+    icon_t *ic;
+
+    if (warmq == NULL)
+        return 0;
+    q = warmq->prev;            // newest first
+    DL_DELETE(warmq, q);
+    HASH_DEL(warmidx, q);
+    HASH_FIND(hh, g.wicon, &(q->id), sizeof(Window), c);
+    ci = windowClassIcon(q->id, c);
+    if (ci != NULL) {
+        ic = classFileIcon(ci, NULL);
+        if (ic != NULL)
+            msg(1, "warmed up icon for %s\n", ic->app);
+    }
+    free(q);
+    return 1;
+}
+
+//
+// replace file icons of winlist by ones made for w x h,
+// the icon size in tiles of current uiShow.
+// the file closest to this size is decoded,
+// instead of scaling option-sized icon while drawing.
+//
+void fitWinlistIcons(unsigned int w, unsigned int h)
+{
+    WindowInfo *wi;
+    int i;
+
+    for (i = 0; i < g.maxNdx; i++) {
+        wi = &(g.winlist[i]);
+        // depth-converted copy is ours, not the file icon's
+        if (wi->icon_file == NULL || wi->icon_allocated)
+            continue;
+        if (!fitIconContent(wi->icon_file, w, h))
+            continue;
+        // windows of the same app share the drawable
+        wi->icon_drawable = wi->icon_file->drawable;
+        wi->icon_mask = wi->icon_file->mask;
+        wi->icon_w = w;
+        wi->icon_h = h;
     }
 }
 
@@ -190,30 +844,45 @@ int startupWintasks(void)
 
     g.sortlist = NULL;          // utlist head must be initialized to NULL
     g.ic = NULL;                // uthash too
+    g.wicon = NULL;
+    // don't delay key grabs and event loop by the icon scan
     if (g.option_iconSrc != ISRC_RAM && g.option_iconSrc != ISRC_NONE) {
-        initIconHash(&(g.ic));
+        startIconHash();
+        // and load icons of existing windows before first show
+        if (g.option_wm == WM_EWMH)
+            ewmh_queueIconWarmup();
     }
     // root: watching for _NET_ACTIVE_WINDOW
     if (g.option_wm == WM_EWMH) {
-        g.naw = XInternAtom(dpy, "_NET_ACTIVE_WINDOW", true);
         rootevmask |= PropertyChangeMask;
     }
+    // root: mirroring window tree, see x_treeEvent
+    if (g.option_wm == WM_NO || g.option_wm == WM_TWM) {
+        rootevmask |= SubstructureNotifyMask;
+    }
+    // root: frame geometry for -sc 0, see winConfigureEvent
+    if (g.option_screen == SCR_CURRENT &&
+        (g.option_vp_mode == VP_POINTER || g.option_vp_mode == VP_FOCUS)) {
+        rootevmask |= SubstructureNotifyMask;
+    }
     // warning: this overwrites any previous value.
     // note: x_setCommonPropertiesForAnyWindow does the similar thing
     // for any window other than root and uiwin
     if (rootevmask != 0) {
         XSelectInput(dpy, root, rootevmask);
     }
+    if (rootevmask & PropertyChangeMask)
+        watchProperties(root);
 
     switch (g.option_wm) {
     case WM_NO:
-        return 1;
+        return x_startupWintasks();
     case WM_RATPOISON:
         return rp_startupWintasks();
     case WM_EWMH:
         return 1;
     case WM_TWM:
-        return 1;
+        return x_startupWintasks();
     default:
         return 0;
     }
@@ -226,16 +895,16 @@ int startupWintasks(void)
 //   fill in "wi->icon_pixmap" and "wi->icon_mask"
 //   and return 1,
 // 0 otherwise.
-//
-#define best_w  pro[best-2]
-#define best_h  pro[best-1]
+// icon sets may take megabytes, so only width/height of every icon
+// is read first, then pixels of the chosen one.
 //
 int addIconFromProperty(WindowInfo * wi)
 {
-    long *pro;
-    long unsigned n, nelem, best;
-    unsigned int w, h;
+    long *pro, *hdr;
+    unsigned long n, total, got, best, nicons;
+    unsigned long w, h, best_w = 0, best_h = 0;
     const char *NWI = "_NET_WM_ICON";
+    Atom nwi;
     uint32_t *image32;
     uint32_t fg;
     uint8_t alpha;
@@ -244,35 +913,63 @@ int addIconFromProperty(WindowInfo * wi)
     int bytes_per_line;
     XImage *img;
     GC gc;
+    SharedIconKey key;
 
-    if ((pro = (long *) get_x_property(wi->id, XA_CARDINAL,
-                    (char*)NWI, &nelem)) == NULL) {
-        msg(1, "Can't find %s (%lx, %s)\n", NWI, wi->id, wi->name);
-        return 0;
-    }
-    nelem = nelem / sizeof(long);
-    msg (1, "Found %lu elements in %s (%lx, %s)\n", nelem, NWI, wi->id, wi->name);
+    nwi = g.atom[AT_NET_WM_ICON];
     best = 0;
+    nicons = 0;
     n = 0;
-    while (n + 2 < nelem) {
-        w = pro[n++];
-        h = pro[n++];
-        if (n + w*h > nelem || w == 0 || h == 0) {
-            msg(1, "Skipping invalid %s icon: element=%lu/%lu w*h=%lux%lu\n", NWI, n, nelem, w, h);
-            n += w*h;
-            continue;
+    total = 3;                  // known after the first read
+    while (n + 2 < total) {
+        hdr = get_x_property_range(wi->id, XA_CARDINAL, nwi, n, 2,
+                                   &got, &total);
+        if (hdr == NULL || got < 2) {
+            free(hdr);
+            break;
         }
+        w = hdr[0];
+        h = hdr[1];
+        free(hdr);
+        n += 2;
+        if (w > 0xffff || h > 0xffff || n + w*h > total) {
+            msg(1, "Skipping invalid %s icon: element=%lu/%lu w*h=%lux%lu\n", NWI, n, total, w, h);
+            break;
+        }
+        if (w == 0 || h == 0)
+            continue;
+        nicons++;
         if (best == 0 || iconMatchBetter(w, h, best_w, best_h, false)) {
             best = n;
+            best_w = w;
+            best_h = h;
         }
         n += w*h;
     }
+    if (n == 0) {
+        msg(1, "Can't find %s (%lx, %s)\n", NWI, wi->id, wi->name);
+        return 0;
+    }
+    msg (1, "Found %lu icons, %lu elements in %s (%lx, %s)\n", nicons, total, NWI, wi->id, wi->name);
     if (best == 0) {
         msg(0, "%s found but no suitable icons in it\n", NWI);
+        return 0;
+    }
+    pro = get_x_property_range(wi->id, XA_CARDINAL, nwi, best,
+                               best_w * best_h, &got, &total);
+    if (pro == NULL || got < best_w * best_h) {
+        msg(0, "%s changed while reading (%lx)\n", NWI, wi->id);
         free(pro);
         return 0;
     }
-    msg(1, "using %dx%d %s icon for %lx\n", w, h, NWI, wi->id);
+    msg(1, "using %lux%lu %s icon for %lx\n", best_w, best_h, NWI, wi->id);
+    // many windows of the same app have the same icon
+    memset(&key, 0, sizeof(key));
+    key.sum = iconChecksum(pro, best_w * best_h);
+    key.w = best_w;
+    key.h = best_h;
+    wi->icon_drawable = findSharedIcon(&key);
+    if (wi->icon_drawable)
+        goto out;
 
     image32 = malloc(best_w * best_h * 4);
     CompositeConst cc = initCompositeConst(g.color[COLBG].xcolor.pixel);
@@ -280,8 +977,8 @@ int addIconFromProperty(WindowInfo * wi)
         for (x = 0; x < best_w; x++) {
             int ndx = y*best_w + x;
             // pro is ARGB by definition
-            fg = pro[best + ndx] & 0x00ffffff;
-            alpha = pro[best + ndx] >> 24;
+            fg = pro[ndx] & 0x00ffffff;
+            alpha = pro[ndx] >> 24;
             image32[ndx] = pixelComposite(fg, alpha, &cc);
         }
     }
@@ -299,6 +996,10 @@ int addIconFromProperty(WindowInfo * wi)
     wi->icon_drawable = XCreatePixmap(dpy, root, best_w, best_h, XDEPTH);
     gc = DefaultGC(dpy, scr);
     XPutImage(dpy, wi->icon_drawable, gc, img, 0, 0, 0, 0, best_w, best_h);
+    addSharedIcon(&key, wi->icon_drawable);
+    XFree(img);
+    free(image32);
+out:
     wi->icon_mask = 0;
     wi->icon_allocated = true;
     wi->icon_w = best_w;
@@ -306,8 +1007,6 @@ int addIconFromProperty(WindowInfo * wi)
 #ifdef ICON_DEBUG
     snprintf(wi->icon_src, MAXNAMESZ, "from %s", NWI);
 #endif
-    XFree(img);
-    free(image32);
     free(pro);
     return 1;
 }
@@ -358,76 +1057,46 @@ int addIconFromHints(WindowInfo * wi)
 }
 
 //
-// search for "wi" application class in PNG hash.
+// search for "wi" application class "ci" in PNG hash.
 // if found, then
 //   if program options don't request size comparison
 //   OR png size match better, then
 //     fill in "wi->icon_pixmap" and "wi->icon_mask"
 //     and return 1
 // return 0 otherwise.
+// see classFileIcon for the lookup itself.
 // slow disk operations possible.
 //
-int addIconFromFiles(WindowInfo * wi)
+int addIconFromFiles(WindowInfo * wi, ClassIcon * ci)
 {
-    char *appclass, *tryclass, *s;
-    long unsigned int class_size;
     icon_t *ic;
-    int ret = 0;
-
-    appclass = get_x_property(wi->id, XA_STRING, "WM_CLASS", &class_size);
-    if (appclass) {
-        for (tryclass = appclass; tryclass - appclass < class_size;
-             tryclass += (strlen(tryclass) + 1)) {
-            s = tryclass;
-            while ((s = strchr(s, '/')) != NULL) *s++ = '_';
-            ic = lookupIcon(tryclass);
-            if (ic && (
-                (g.option_iconSrc != ISRC_SIZE 
-                        && g.option_iconSrc != ISRC_SIZE2)
-                 || (g.option_iconSrc == ISRC_SIZE 
-                        && iconMatchBetter(
-                                    ic->src_w, ic->src_h,
-                                    wi->icon_w, wi->icon_h,
-                                    false))
-                 || (g.option_iconSrc == ISRC_SIZE2 
-                        && iconMatchBetter(
-                                    ic->src_w, ic->src_h,
-                                    wi->icon_w, wi->icon_h,
-                                    true))
-                )) {
-                msg(0, "using file icon for %s\n", tryclass);
-                if (ic->drawable == None) {
-                    msg(1, "loading content for %s\n", ic->app);
-                    if (loadIconContent(ic) == 0) {
-                        msg(-1, "can't load file icon content: %s\n", ic->src_path);
-                        continue;
-                    }
-                }
-                // for the case when icon was already found in window props
-                if (wi->icon_allocated) {
-                    XFreePixmap(dpy, wi->icon_drawable);
-                    /*
-                    if (wi->icon_mask != None) {
-                       XFreePixmap(dpy, wi->icon_mask);
-                    }
-                    */
-                    wi->icon_allocated = false;
-                }
-                wi->icon_drawable = ic->drawable;
-                wi->icon_mask = ic->mask;
-#ifdef ICON_DEBUG
-                strncpy(wi->icon_src, ic->src_path, MAXNAMESZ);
-#endif
-                ret = 1;
-                goto out;
-            }
-        }
-    } else {
+
+    if (ci == NULL) {
         msg(0, "can't find WM_CLASS for \"%s\"\n", wi->name);
+        return 0;
     }
-out:
-    free(appclass);
-    return ret;
+    ic = classFileIcon(ci, wi);
+    if (ic == NULL)
+        return 0;
+    msg(0, "using file icon for %s\n", ic->app);
+    // for the case when icon was already found in window props
+    if (wi->icon_allocated) {
+        releaseIconPixmap(wi->icon_drawable);
+        /*
+        if (wi->icon_mask != None) {
+           XFreePixmap(dpy, wi->icon_mask);
+        }
+        */
+        wi->icon_allocated = false;
+    }
+    wi->icon_drawable = ic->drawable;
+    wi->icon_mask = ic->mask;
+    wi->icon_file = ic;
+#ifdef ICON_DEBUG
+    snprintf(wi->icon_src, MAXNAMESZ, "%s/%s",
+             ic->src_dir, ic->src_name);
+#endif
+    return 1;
 }
 
 //
@@ -453,7 +1122,11 @@ int addWindowInfo(Window win, int reclevel, int wm_id, unsigned long desktop,
         XTextProperty text_prop;
         char **list = NULL;
         int count;
-        if (XGetWMName(dpy, win, &text_prop) && text_prop.value) {
+        unsigned long after;
+        if (checked_x_property(win, XA_WM_NAME, AnyPropertyType, 0,
+                               MAXPROPLEN / 4, &text_prop.encoding,
+                               &text_prop.format, &text_prop.nitems, &after,
+                               &text_prop.value) && text_prop.value) {
             // trying to interpret the name as a UTF-8
             if (Xutf8TextPropertyToTextList(dpy, &text_prop, &list, &count) >= Success && count > 0 && list) {
                 strncpy(WI.name, list[0], MAXNAMESZ - 1);
@@ -463,7 +1136,7 @@ int addWindowInfo(Window win, int reclevel, int wm_id, unsigned long desktop,
                 strncpy(WI.name, (char *)text_prop.value, MAXNAMESZ - 1);
                 WI.name[MAXNAMESZ - 1] = '\0';
             }
-            XFree(text_prop.value);
+            free(text_prop.value);
         } else {
             WI.name[0] = '\0';
         }
@@ -481,8 +1154,8 @@ int addWindowInfo(Window win, int reclevel, int wm_id, unsigned long desktop,
     WI.icon_drawable =
         WI.icon_mask =
         WI.icon_w = WI.icon_h = 0;
-    unsigned int icon_depth = 0;
     WI.icon_allocated = false;
+    WI.icon_file = NULL;
 #ifdef ICON_DEBUG
     WI.icon_src[0] = '\0';
 #endif
@@ -492,58 +1165,35 @@ int addWindowInfo(Window win, int reclevel, int wm_id, unsigned long desktop,
     int icon_in_x = 0;
     if (opt == ISRC_NONE)
         goto endIcon;
-    if (opt != ISRC_FILES) {
-        icon_in_x = addIconFromProperty(&(WI));
-        if (!icon_in_x)
-            icon_in_x = addIconFromHints(&(WI));
-    }
+    WindowIcon *wic = windowIconEntry(win);
+    ClassIcon *ci = NULL;
+    if (opt != ISRC_RAM)
+        ci = windowClassIcon(win, wic);
+    // with -s 2, 3 don't build icon from X only to drop it,
+    // if file icon won for this class before
+    if (opt != ISRC_FILES && !(ci && ci->file_wins))
+        icon_in_x = addIconFromX(&(WI), wic);
     if ((opt == ISRC_FALLBACK && !icon_in_x) ||
-        opt == ISRC_SIZE || opt == ISRC_SIZE2 || opt == ISRC_FILES)
-        addIconFromFiles(&(WI));
-
-    // extract icon width/height/depth
-    Window root_return;
-    int x_return, y_return;
-    unsigned int border_width_return;
-    if (WI.icon_drawable) {
-        if (XGetGeometry(dpy, WI.icon_drawable,
-                         &root_return, &x_return, &y_return,
-                         &(WI.icon_w),
-                         &(WI.icon_h),
-                         &border_width_return, &icon_depth) == 0) {
-            msg(0, "icon dimensions unknown (%s)\n", WI.name);
-            // probably draw placeholder?
-            WI.icon_drawable = 0;
-        } else {
-            msg(1, "depth=%d\n", icon_depth);
+        opt == ISRC_SIZE || opt == ISRC_SIZE2 || opt == ISRC_FILES) {
+        int icon_in_file = addIconFromFiles(&(WI), ci);
+        if (ci && (opt == ISRC_SIZE || opt == ISRC_SIZE2)) {
+            if (!icon_in_file && ci->file_wins)
+                addIconFromX(&(WI), wic);     // file is gone, back to X
+            // loser from X isn't needed anymore
+            if (icon_in_file && wic && !wic->stale) {
+                dropWindowIcon(wic);
+                wic->stale = true;
+            }
+            ci->file_wins = icon_in_file;
         }
     }
-// convert icon with different depth (currently 1 only) into default depth
-    if (WI.icon_drawable && icon_depth == 1) {
-        msg(0,
-            "rebuilding icon from depth %d to %d (%s)\n",
-            icon_depth, XDEPTH, WI.name);
-        Pixmap pswap = XCreatePixmap(dpy, WI.icon_drawable,
-                                     WI.icon_w,
-                                     WI.icon_h, XDEPTH);
-        if (!pswap)
-            die("can't create pixmap");
-        // GC should be already prepared in uiShow
-        if (!XCopyPlane
-            (dpy, WI.icon_drawable, pswap, g.gcDirect,
-             0, 0, WI.icon_w,
-             WI.icon_h, 0, 0, 1))
-            die("can't copy plane");    // plane #1?
-        WI.icon_drawable = pswap;
-        WI.icon_allocated = true;  // for subsequent free()
-        icon_depth = XDEPTH;
-    }
-    if (WI.icon_drawable && icon_depth != XDEPTH) {
-        msg(-1,
-            "can't handle icon depth other than %d or 1 (%d, %s). Please report this condition.\n",
-            XDEPTH, icon_depth, WI.name);
-        WI.icon_drawable = WI.icon_w =
-            WI.icon_h = 0;
+    // icon from X is already measured and converted.
+    // file icon is of default depth, and its size is known since loading
+    if (WI.icon_file != NULL) {
+        WI.icon_w = WI.icon_file->drawable_w;
+        WI.icon_h = WI.icon_file->drawable_h;
+        if (WI.icon_w == 0 || WI.icon_h == 0)
+            setIconGeometry(&(WI));
     }
 endIcon:
 
@@ -568,7 +1218,7 @@ endIcon:
             break;
         case BL_USER:
             pid = (long unsigned int*)get_x_property(WI.id,
-                    XA_CARDINAL, "_NET_WM_PID", &nws);
+                    XA_CARDINAL, g.atom[AT_NET_WM_PID], &nws);
             if (!pid) {
                 strncpy(WI.bottom_line, "[no pid]", 9);
                 break;
@@ -615,13 +1265,15 @@ static void __initWinlist(void)
 int initWinlist(void)
 {
     int r;
+    // pick up file icons if background scan is finished
+    pollIconHash(false);
     if (g.debug > 1) {
         msg(1, "before initWinlist\n");
         print_sortlist();
     }
     switch (g.option_wm) {
     case WM_NO:
-        r = x_initWindowsInfoRecursive(root, 0);    // note: direction/current window index aren't used
+        r = x_initWinlist();    // note: direction/current window index aren't used
         break;
     case WM_RATPOISON:
         r = rp_initWinlist();
@@ -630,7 +1282,7 @@ int initWinlist(void)
         r = ewmh_initWinlist();
         break;
     case WM_TWM:
-        r = x_initWindowsInfoRecursive(root, 0);
+        r = x_initWinlist();
         break;
     default:
         r = 0;
@@ -646,11 +1298,13 @@ int initWinlist(void)
         print_sortlist();
         print_winlist();
     }
-    qsort(g.winlist, g.maxNdx, sizeof(WindowInfo), sort_by_order);
+    sortWinlist();
     if (g.debug > 1) {
         msg(1, "after qsort\n");
         print_winlist();
     }
+    // properties read in a batch by WM-specific part are outdated now
+    dropPrefetchedProperties();
 
     msg(1, "initWinlist ret: number of items in winlist: %d\n", g.maxNdx);
 
@@ -659,7 +1313,8 @@ int initWinlist(void)
 
 //
 // counterpair for initWinlist
-// frees icons and winlist, but not tiles, as they are allocated in gui.c
+// frees icons and winlist, but not tiles, as they are kept in gui.c,
+// and not icons from X, as they are kept in g.wicon
 //
 void freeWinlist(void)
 {
@@ -671,7 +1326,7 @@ void freeWinlist(void)
     int y;
     for (y = 0; y < g.maxNdx; y++) {
         if (g.winlist[y].icon_allocated)
-            XFreePixmap(dpy, g.winlist[y].icon_drawable);
+            releaseIconPixmap(g.winlist[y].icon_drawable);
     }
     __initWinlist();
 }
@@ -719,6 +1374,7 @@ int setFocus(int winNdx)
 // event handler for PropertyChange
 // most of the time called when winlist[] is not initialized
 // currently it updates sortlist on _NET_ACTIVE_WINDOW change
+// and marks cached icon of a window stale on its icon change
 // because it's a handler of frequent event,
 // there are shortcuts to return as soon as possible
 //
@@ -726,14 +1382,32 @@ void winPropChangeEvent(XPropertyEvent e)
 // man XPropertyEvent
 {
     Window aw;
-    // no _NET_ACTIVE_WINDOW atom, probably not EWMH?
-    if (g.naw == None)
-        return;
-    // property change event not for root window?
-    if (e.window != root)
+    WindowIcon *c;
+    // kept by prefetchProperties?
+    forgetProperty(e.window, e.atom);
+    // icon or class of foreign window changed?
+    if (e.window != root) {
+        if (e.atom != g.atom[AT_NET_WM_ICON] && e.atom != XA_WM_HINTS
+            && e.atom != XA_WM_CLASS)
+            return;
+        HASH_FIND(hh, g.wicon, &(e.window), sizeof(Window), c);
+        if (c != NULL && e.atom == XA_WM_CLASS) {
+            c->cls = NULL;      // read again on next uiShow
+            return;
+        }
+        if (c != NULL && e.atom == XA_WM_HINTS && c->allocated)
+            unshareHintsIcon(c->drawable);
+        if (c != NULL && !c->stale) {
+            msg(1, "event PropertyChange: icon of 0x%lx changed\n",
+                e.window);
+            // not freed yet: may be in use by current winlist
+            c->stale = true;
+        }
+        uiForgetTile(e.window);
         return;
+    }
     // root property other than _NET_ACTIVE_WINDOW changed?
-    if (e.atom != g.naw)
+    if (e.atom != g.atom[AT_NET_ACTIVE_WINDOW])
         return;
     // don't check for wm==EWMH, because _NET_ACTIVE_WINDOW changed for sure
     aw = ewmh_getActiveWindow();
@@ -781,22 +1455,82 @@ void winPropChangeEvent(XPropertyEvent e)
 
 //
 // DestroyNotify handler
-// removes the window from sortlist
+// removes the window from sortlist, its icon from g.wicon
+// and its tile from gui.c cache
 //
 void winDestroyEvent(XDestroyWindowEvent e)
 // man XDestroyWindowEvent
 {
     PermanentWindowInfo *s;
 
-    DL_SEARCH_SCALAR(g.sortlist, s, id, e.window);
+    HASH_FIND(hh, sortidx, &(e.window), sizeof(Window), s);
     if (s != NULL) {
         msg(1,
             "event DestroyNotify: 0x%lx found in sortlist, removing\n",
             e.window);
-        DL_DELETE(g.sortlist, s);
+        removeFromSortlist(s);
+    }
+    forgetWindow(e.window);
+}
+
+//
+// ConfigureNotify: of a window with known geometry
+// or of window between it and its frame (StructureNotify),
+// or of a frame (SubstructureNotify on root)
+//
+void winConfigureEvent(XConfigureEvent e)
+// man XConfigureEvent
+{
+    WindowGeometry *wg, *tmp;
+    int fx, fy;
+
+    if (geomidx == NULL)
+        return;
+    HASH_FIND(hh, geomidx, &(e.window), sizeof(Window), wg);
+    if (wg != NULL && wg->frame != e.window) {
+        // window resized or moved inside the frame.
+        // position is relative to parent, which isn't necessarily the frame.
+        // synthetic event (ICCCM 4.1.5) repeats what frame event tells.
+        if (!e.send_event)
+            forgetGeometry(e.window);
+        return;
+    }
+    if (e.send_event)
+        return;
+    if (e.event != root) {
+        // window between frame and window moved or resized.
+        // it's not in geomidx itself, unless it's top-level
+        if (wg == NULL)
+            forgetGeometry(e.window);
+        return;
+    }
+    // frame moved: so did windows in it.
+    // frame resize isn't enough to know window size,
+    // it is told by ConfigureNotify of the window itself.
+    fx = e.x + e.border_width;
+    fy = e.y + e.border_width;
+    HASH_ITER(hh, geomidx, wg, tmp) {
+        if (wg->frame != e.window)
+            continue;
+        wg->q.x += fx - wg->fx;
+        wg->q.y += fy - wg->fy;
+        wg->fx = fx;
+        wg->fy = fy;
+        if (wg->id == e.window) {
+            wg->q.w = e.width;
+            wg->q.h = e.height;
+        }
     }
 }
 
+//
+// ReparentNotify: window got new frame
+//
+void winReparentEvent(XReparentEvent e)
+{
+    forgetGeometry(e.window);
+}
+
 //
 // common filter before adding window to winlist
 // it checks: desktop, screen
@@ -834,7 +1568,7 @@ bool common_skipWindow(Window w,
     // assuming g.vp already calculated in gui.c
     if (g.option_screen == SCR_CURRENT &&
         (g.option_vp_mode == VP_POINTER || g.option_vp_mode == VP_FOCUS)) {
-        if (!get_absolute_coordinates(w, &wq)) {
+        if (!winGeometry(w, &wq)) {
             msg(-1,
                 "can't get coordinates of window 0x%lx, included anyway\n", w);
         } else {
@@ -882,5 +1616,43 @@ void winFocusChangeEvent(XFocusChangeEvent e)
 
 void shutdownWin(void)
 {
+    WindowIcon *c, *tmp;
+    ClassIcon *ci, *citmp;
+    WindowGeometry *wg, *wgtmp;
+    WarmupWindow *wq, *wqtmp;
+    int i;
+
+    HASH_ITER(hh, g.wicon, c, tmp) {
+        HASH_DEL(g.wicon, c);
+        dropWindowIcon(c);
+        free(c);
+    }
+    HASH_ITER(hh, classicons, ci, citmp) {
+        HASH_DEL(classicons, ci);
+        free(ci->wmclass);
+        free(ci);
+    }
+    pollIconHash(true);
+    closeIconWatch();
+    HASH_ITER(hh, warmidx, wq, wqtmp) {
+        HASH_DEL(warmidx, wq);
+        free(wq);
+    }
+    warmq = NULL;
     deleteIconHash(&g.ic);
+    freeIconStrings();
+    x_shutdownWintasks();
+    HASH_ITER(hh, geomidx, wg, wgtmp) {
+        HASH_DEL(geomidx, wg);
+        free(wg);
+    }
+    shutdownProperties();
+    HASH_CLEAR(hh, sortidx);
+    g.sortlist = NULL;
+    sortpool = NULL;
+    for (i = 0; i < nsortchunks; i++)
+        free(sortchunks[i]);
+    free(sortchunks);
+    sortchunks = NULL;
+    nsortchunks = 0;
 }
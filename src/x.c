@@ -22,8 +22,14 @@ along with alttab.  If not, see <http://www.gnu.org/licenses/>.
 #include <X11/Xutil.h>
 #include <X11/Xft/Xft.h>
 #include <X11/Xatom.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uthash.h>
+#include <utlist.h>
 #include "alttab.h"
 #include "util.h"
 extern Globals g;
@@ -33,6 +39,287 @@ extern Window root;
 
 // PRIVATE
 
+//
+// mirror of window tree, kept by SubstructureNotify events,
+// so that the winlist is built without asking X for the tree.
+//
+typedef struct TreeWindow {
+    Window id;                  // uthash key
+    struct TreeWindow *parent;
+    struct TreeWindow *children;        // utlist, bottom to top
+    struct TreeWindow *prev, *next;     // siblings
+    int reclevel;               // root is 0
+    bool mapped;                // by itself, ancestors aren't checked
+    long evmask;                // our event mask on this window
+    UT_hash_handle hh;
+} TreeWindow;
+
+static TreeWindow *treeidx = NULL;
+static TreeWindow *treeroot = NULL;
+
+static TreeWindow *treeFind(Window w)
+{
+    TreeWindow *t;
+
+    HASH_FIND(hh, treeidx, &w, sizeof(Window), t);
+    return t;
+}
+
+//
+// are children of window at this level mirrored:
+// down to option_max_reclevel, as XQueryTree walk did
+//
+static bool treeDescends(int reclevel)
+{
+    return g.option_max_reclevel == -1 || reclevel < g.option_max_reclevel;
+}
+
+//
+// are children of new node t walked by treeAdd:
+// within option_max_reclevel, and reported to us afterwards.
+// a mask selected earlier doesn't take the walk deeper.
+//
+static bool treeQueries(TreeWindow * t)
+{
+    return t != NULL && treeDescends(t->reclevel)
+        && (t->evmask & SubstructureNotifyMask);
+}
+
+//
+// new mirror node, placed on top of its siblings.
+// map_state and evmask are those of XWindowAttributes.
+//
+static TreeWindow *treeNode(Window w, TreeWindow * parent, int map_state,
+                            long evmask)
+{
+    TreeWindow *t;
+    long oldmask = evmask;
+
+    t = malloc(sizeof(TreeWindow));
+    if (t == NULL)
+        return NULL;
+    memset(t, 0, sizeof(TreeWindow));
+    t->id = w;
+    t->parent = parent;
+    t->reclevel = parent ? parent->reclevel + 1 : 0;
+    t->mapped = (map_state != IsUnmapped);
+    // keep what x_setCommonPropertiesForAnyWindow selected
+    if (w != getUiwin()) {
+        if (treeDescends(t->reclevel))
+            evmask |= SubstructureNotifyMask;
+    }
+    t->evmask = evmask;
+    if (evmask != oldmask)
+        XSelectInput(dpy, w, evmask);
+    if (evmask & PropertyChangeMask)
+        watchProperties(w);
+    HASH_ADD(hh, treeidx, id, sizeof(Window), t);
+    if (parent != NULL)
+        DL_APPEND(parent->children, t);
+    return t;
+}
+
+//
+// start to mirror window w and its subtree.
+// the tree is walked breadth-first: requests for the whole level
+// are sent at once, then replies are collected,
+// so there are two round trips per level, not per window.
+// levels below option_max_reclevel aren't walked, see treeQueries.
+// events are selected before the query of children,
+// so children created meanwhile are reported by CreateNotify,
+// and found here already.
+// return NULL if the window is gone
+//
+static TreeWindow *treeAdd(Window w, TreeWindow * parent)
+{
+    xcb_connection_t *xc;
+    xcb_get_window_attributes_cookie_t *ac;
+    xcb_get_window_attributes_reply_t *ar;
+    xcb_query_tree_cookie_t *qc;
+    xcb_query_tree_reply_t **qr;
+    xcb_window_t *children;
+    TreeWindow *top = NULL, **parents, **nodes, **nparents;
+    Window *wins, *nwins;
+    int n, nn, i, j, c, level = 0;
+
+    top = treeFind(w);
+    if (top != NULL)
+        return top;
+    xc = XGetXCBConnection(dpy);
+    n = 1;
+    wins = malloc(sizeof(Window));
+    parents = malloc(sizeof(TreeWindow *));
+    if (wins == NULL || parents == NULL) {
+        free(wins);
+        free(parents);
+        return NULL;
+    }
+    wins[0] = w;
+    parents[0] = parent;
+    while (n > 0) {
+        ac = malloc(n * sizeof(xcb_get_window_attributes_cookie_t));
+        qc = malloc(n * sizeof(xcb_query_tree_cookie_t));
+        qr = malloc(n * sizeof(xcb_query_tree_reply_t *));
+        nodes = malloc(n * sizeof(TreeWindow *));
+        if (ac == NULL || qc == NULL || qr == NULL || nodes == NULL) {
+            free(ac);
+            free(qc);
+            free(qr);
+            free(nodes);
+            break;
+        }
+        // attributes of the whole level
+        for (i = 0; i < n; i++)
+            ac[i] = xcb_get_window_attributes(xc, wins[i]);
+        for (i = 0; i < n; i++) {
+            nodes[i] = NULL;
+            ar = xcb_get_window_attributes_reply(xc, ac[i], NULL);
+            if (ar == NULL) {
+                msg(1, "tree: window 0x%lx is gone\n", wins[i]);
+                continue;
+            }
+            // CreateNotify may have added it meanwhile
+            if (treeFind(wins[i]) == NULL)
+                nodes[i] = treeNode(wins[i], parents[i], ar->map_state,
+                                    ar->your_event_mask);
+            free(ar);
+        }
+        if (level == 0)
+            top = nodes[0];
+        // children of the whole level
+        for (i = 0; i < n; i++) {
+            if (treeQueries(nodes[i]))
+                qc[i] = xcb_query_tree(xc, wins[i]);
+        }
+        nn = 0;
+        for (i = 0; i < n; i++) {
+            qr[i] = NULL;
+            if (!treeQueries(nodes[i]))
+                continue;
+            qr[i] = xcb_query_tree_reply(xc, qc[i], NULL);
+            if (qr[i] == NULL)
+                msg(0, "can't get window tree for 0x%lx\n", wins[i]);
+            else
+                nn += xcb_query_tree_children_length(qr[i]);
+        }
+        // next level, bottom to top within each parent
+        nwins = malloc(nn * sizeof(Window));
+        nparents = malloc(nn * sizeof(TreeWindow *));
+        j = 0;
+        for (i = 0; i < n; i++) {
+            if (qr[i] == NULL)
+                continue;
+            children = xcb_query_tree_children(qr[i]);
+            for (c = 0; c < xcb_query_tree_children_length(qr[i]); c++) {
+                if (nwins != NULL && nparents != NULL) {
+                    nwins[j] = children[c];
+                    nparents[j] = nodes[i];
+                    j++;
+                }
+            }
+            free(qr[i]);
+        }
+        free(ac);
+        free(qc);
+        free(qr);
+        free(nodes);
+        free(wins);
+        free(parents);
+        wins = nwins;
+        parents = nparents;
+        n = (wins != NULL && parents != NULL) ? j : 0;
+        level++;
+    }
+    free(wins);
+    free(parents);
+    return top;
+}
+
+//
+// stop to mirror window and its subtree
+//
+static void treeRemove(TreeWindow * t)
+{
+    TreeWindow *c, *tmp;
+
+    DL_FOREACH_SAFE(t->children, c, tmp) {
+        treeRemove(c);
+    }
+    if (t->parent != NULL)
+        DL_DELETE(t->parent->children, t);
+    if (t == treeroot)
+        treeroot = NULL;
+    HASH_DEL(treeidx, t);
+    free(t);
+}
+
+//
+// move window in stacking order of its siblings.
+// above is the sibling just below it, or None for the bottom.
+//
+static void treeRestack(TreeWindow * t, Window above)
+{
+    TreeWindow *a;
+
+    if (t->parent == NULL)
+        return;
+    a = treeFind(above);
+    if (a == t || (a != NULL && a->parent != t->parent))
+        return;
+    DL_DELETE(t->parent->children, t);
+    if (a == NULL)
+        DL_PREPEND(t->parent->children, t);
+    else if (a->next == NULL)
+        DL_APPEND(t->parent->children, t);
+    else
+        DL_PREPEND_ELEM(t->parent->children, a->next, t);
+}
+
+//
+// in twm, WM_NAME of named window is kept by prefetchProperties
+// until it changes. unnamed windows aren't watched.
+//
+static void treeWatchName(TreeWindow * t)
+{
+    if (watchingProperties(t->id))
+        return;
+    t->evmask |= PropertyChangeMask;
+    XSelectInput(dpy, t->id, t->evmask);
+    watchProperties(t->id);
+}
+
+//
+// add viewable (in twm: named) windows of the subtree to winlist.
+// viewable: all ancestors are mapped.
+//
+static void treeInitWinlist(TreeWindow * t, bool viewable)
+{
+    TreeWindow *c;
+    char *winname;
+
+    viewable = viewable && t->mapped;
+// in twm-like, add only windows with a name
+    winname = NULL;
+    if (g.option_wm == WM_TWM && t->reclevel != 0) {
+        winname = get_x_property(t->id, XA_STRING, XA_WM_NAME, NULL);
+        if (winname != NULL)
+            treeWatchName(t);
+    }
+// insert detailed window data in window list
+// caveat: in rp, skips anything except of visible window
+    if ((g.option_wm == WM_TWM || viewable)
+        && t->reclevel != 0 && (g.option_wm != WM_TWM || winname != NULL)
+        && t->id != getUiwin()
+        && !common_skipWindow(t->id, DESKTOP_UNKNOWN, DESKTOP_UNKNOWN)
+        ) {
+        addWindowInfo(t->id, t->reclevel, 0, DESKTOP_UNKNOWN, winname);
+    }
+    free(winname);
+    DL_FOREACH(t->children, c) {
+        treeInitWinlist(c, viewable);
+    }
+}
+
 //
 // get window group leader
 // to be used later. rewritten, not tested.
@@ -44,7 +331,8 @@ Window x_get_leader(Window win)
     Window leader = None;
 
     retprop =
-        (Window *) get_x_property(win, XA_WINDOW, "WM_CLIENT_LEADER", NULL);
+        (Window *) get_x_property(win, XA_WINDOW, g.atom[AT_WM_CLIENT_LEADER],
+                                  NULL);
     if (retprop != NULL) {
         leader = retprop[0];
         XFree(retprop);
@@ -60,18 +348,36 @@ Window x_get_leader(Window win)
 // PUBLIC
 
 //
-// set winlist,maxNdx recursively using raw Xlib
-// first call should be (win=root, reclevel=0)
+// start to mirror window tree.
+// SubstructureNotifyMask on root must be selected before.
+//
+int x_startupWintasks(void)
+{
+    treeroot = treeAdd(root, NULL);
+    if (treeroot == NULL)
+        return 0;
+    msg(0, "mirroring %u windows\n", HASH_COUNT(treeidx));
+    return 1;
+}
+
+//
+// stop to mirror window tree
 //
-int x_initWindowsInfoRecursive(Window win, int reclevel)
+void x_shutdownWintasks(void)
 {
+    if (treeroot != NULL)
+        treeRemove(treeroot);
+}
 
-    Window root, parent;
-    Window *children;
-    unsigned int nchildren, i;
-//    Window leader;
-    XWindowAttributes wa;
-    char *winname;
+//
+// set winlist,maxNdx from the mirror of window tree
+//
+int x_initWinlist(void)
+{
+    TreeWindow *t, *tmp;
+    Window *wins;
+    Atom wm_name = XA_WM_NAME;
+    int n = 0;
 
 // check if window is "leader" or no prop, skip otherwise
 // caveat: in rp, gvim leader has no file name and icon
@@ -84,43 +390,83 @@ int x_initWindowsInfoRecursive(Window win, int reclevel)
         msg(1, "win: 0x%lx leader: 0x%lx\n", win, leader);
     }
 */
-// in non-twm, add viewable only
-// caveat: in rp, skips anything except of visible window
-// probably add an option for this in WMs too?
-    wa.map_state = 0;
-    if (g.option_wm != WM_TWM)
-        XGetWindowAttributes(dpy, win, &wa);
-
-// in twm-like, add only windows with a name
-    winname = NULL;
+    if (treeroot == NULL)
+        return 0;
+// in twm-like, names of all windows are needed.
+// those of named windows are kept between calls.
     if (g.option_wm == WM_TWM) {
-        winname = get_x_property(win, XA_STRING, "WM_NAME", NULL);
+        wins = malloc(HASH_COUNT(treeidx) * sizeof(Window));
+        if (wins != NULL) {
+            HASH_ITER(hh, treeidx, t, tmp) {
+                if (t != treeroot)
+                    wins[n++] = t->id;
+            }
+            prefetchProperties(wins, n, &wm_name, 1);
+            free(wins);
+        }
     }
-// insert detailed window data in window list
-    if ((g.option_wm == WM_TWM || wa.map_state == IsViewable)
-        && reclevel != 0 && (g.option_wm != WM_TWM || winname != NULL)
-//            && (g.option_wm != WM_TWM || leader == win)
-        && !common_skipWindow(win, DESKTOP_UNKNOWN, DESKTOP_UNKNOWN)
-        ) {
-        addWindowInfo(win, reclevel, 0, DESKTOP_UNKNOWN, winname);
-    }
-// skip children if max recursion level reached
-    if (g.option_max_reclevel != -1 && reclevel >= g.option_max_reclevel)
-        return 1;
+    treeInitWinlist(treeroot, true);
+    return 1;
+}
 
-// recursion
-    if (XQueryTree(dpy, win, &root, &parent, &children, &nchildren) == 0) {
-        msg(0, "can't get window tree for 0x%lx\n", win);
-        return 0;
-    }
-    for (i = 0; i < nchildren; ++i) {
-        x_initWindowsInfoRecursive(children[i], reclevel + 1);
-    }
+//
+// keep the mirror of window tree.
+// the same event may come twice: for the window and for its parent.
+//
+void x_treeEvent(XEvent * ev)
+{
+    TreeWindow *t, *p;
 
-    if (nchildren > 0 && children) {
-        XFree(children);
+    if (treeroot == NULL)
+        return;
+    switch (ev->type) {
+    case CreateNotify:
+        p = treeFind(ev->xcreatewindow.parent);
+        if (p != NULL && treeDescends(p->reclevel))
+            treeAdd(ev->xcreatewindow.window, p);
+        break;
+    case DestroyNotify:
+        t = treeFind(ev->xdestroywindow.window);
+        if (t != NULL)
+            treeRemove(t);
+        break;
+    case MapNotify:
+        t = treeFind(ev->xmap.window);
+        if (t != NULL)
+            t->mapped = true;
+        break;
+    case UnmapNotify:
+        t = treeFind(ev->xunmap.window);
+        if (t != NULL)
+            t->mapped = false;
+        break;
+    case ReparentNotify:
+        t = treeFind(ev->xreparent.window);
+        p = treeFind(ev->xreparent.parent);
+        if (t != NULL && t->parent == p)
+            break;
+        // reclevel of the subtree changes: mirror it anew
+        if (t != NULL)
+            treeRemove(t);
+        if (p != NULL && treeDescends(p->reclevel))
+            treeAdd(ev->xreparent.window, p);
+        break;
+    case ConfigureNotify:
+        t = treeFind(ev->xconfigure.window);
+        if (t != NULL)
+            treeRestack(t, ev->xconfigure.above);
+        break;
+    case CirculateNotify:
+        t = treeFind(ev->xcirculate.window);
+        if (t == NULL || t->parent == NULL)
+            break;
+        DL_DELETE(t->parent->children, t);
+        if (ev->xcirculate.place == PlaceOnTop)
+            DL_APPEND(t->parent->children, t);
+        else
+            DL_PREPEND(t->parent->children, t);
+        break;
     }
-    return 1;
 }
 
 //
@@ -149,25 +495,62 @@ int x_setFocus(int wndx)
     return 1;
 }
 
+//
+// add "mask" to events selected on foreign window w,
+// keeping what is selected there already
+//
+void x_addEventMask(Window w, long mask)
+{
+    TreeWindow *t;
+    XWindowAttributes wa;
+
+    t = treeFind(w);
+    if (t != NULL) {
+        if ((t->evmask & mask) == mask)
+            return;
+        t->evmask |= mask;
+        XSelectInput(dpy, w, t->evmask);
+        return;
+    }
+    if (XGetWindowAttributes(dpy, w, &wa) == 0)
+        return;
+    if ((wa.your_event_mask & mask) != mask)
+        XSelectInput(dpy, w, wa.your_event_mask | mask);
+}
+
 //
 // this is where alttab is supposed to set properties or
 // register interest in event for ANY foreign window encountered.
-// warning: this is called only on addition to sortlist.
+// warning: this is called only on addition to sortlist
+// and for EWMH clients which aren't watched yet.
 //
 void x_setCommonPropertiesForAnyWindow(Window win)
 {
+    TreeWindow *t;
     long evmask = 0;
     // root and our window are treated elsewhere
     if (win == root || win == getUiwin())
         return;
     // for delete notification
     evmask |= StructureNotifyMask;
+    // for invalidation of cached icon and class, see winPropChangeEvent,
+    // and of properties kept by prefetchProperties
+    if (g.option_iconSrc != ISRC_NONE || g.option_wm == WM_EWMH)
+        evmask |= PropertyChangeMask;
     // for focusIn notification
     if (g.option_wm != WM_EWMH) {
         msg(0, "using direct focus tracking for 0x%lx\n", win);
         evmask |= FocusChangeMask;
     }
-    // warning: this overwrites previous value
+    // warning: this overwrites previous value,
+    // except of what the window tree mirror selected
+    t = treeFind(win);
+    if (t != NULL) {
+        t->evmask |= evmask;
+        evmask = t->evmask;
+    }
     if (evmask != 0)
         XSelectInput(dpy, win, evmask);
+    if (evmask & PropertyChangeMask)
+        watchProperties(win);
 }
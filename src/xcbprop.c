@@ -0,0 +1,381 @@
+/*
+Fetch of window properties via XCB.
+
+Xlib XGetWindowProperty waits for the reply of every request.
+Here all requests for all windows are sent first, then replies
+are collected, so the whole batch costs about one round trip.
+get_x_property takes the results from here while they are kept.
+Results for windows which report PropertyNotify to us (see
+watchProperties) are kept between shows until the property changes,
+so they mirror the state of those windows without asking X again.
+
+Single properties are fetched here too: XCB returns an error
+(f.e., window is gone) with the reply of its own request,
+so there is no need in XSync to make it appear in Xlib error handler.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <X11/Xlib.h>
+#include <X11/Xlib-xcb.h>
+#include <xcb/xcb.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <uthash.h>
+#include "alttab.h"
+#include "util.h"
+extern Globals g;
+extern Display *dpy;
+
+// PRIVATE
+
+typedef struct {
+    Window win;
+    Atom prop;
+} PropKey;
+
+// property as XGetWindowProperty would return it
+typedef struct {
+    PropKey key;                // uthash key
+    Atom type;                  // None if there is no such property or window
+    int format;
+    unsigned long nitems;
+    unsigned char *data;        // format 32 items are longs, like in Xlib
+    bool watched;               // window was watched when requested
+    UT_hash_handle hh;
+} PropEntry;
+
+static PropEntry *prefetched = NULL;
+
+// windows with PropertyChangeMask selected by us
+typedef struct {
+    Window id;                  // uthash key
+    UT_hash_handle hh;
+} WatchedWindow;
+
+static WatchedWindow *watched = NULL;
+
+//
+// free batch entry
+//
+static void dropEntry(PropEntry * pe)
+{
+    HASH_DEL(prefetched, pe);
+    free(pe->data);
+    free(pe);
+}
+
+//
+// value of xcb reply in Xlib layout: format 32 items become longs.
+// return malloc'ed copy with extra zero byte, or NULL
+//
+static unsigned char *replyValue(xcb_get_property_reply_t * rep)
+{
+    unsigned char *data;
+    uint32_t *v32;
+    long *vl;
+    int len, i;
+
+    if (rep->format == 32) {
+        vl = malloc(rep->value_len * sizeof(long) + 1);
+        if (vl == NULL)
+            return NULL;
+        v32 = xcb_get_property_value(rep);
+        for (i = 0; i < rep->value_len; i++)
+            vl[i] = v32[i];
+        ((unsigned char *)vl)[rep->value_len * sizeof(long)] = '\0';
+        return (unsigned char *)vl;
+    }
+    len = xcb_get_property_value_length(rep);
+    data = malloc(len + 1);
+    if (data == NULL)
+        return NULL;
+    memcpy(data, xcb_get_property_value(rep), len);
+    data[len] = '\0';
+    return data;
+}
+
+//
+// convert xcb reply into PropEntry data
+//
+static void storeReply(PropEntry * pe, xcb_get_property_reply_t * rep)
+{
+    pe->type = rep->type;
+    pe->format = rep->format;
+    pe->nitems = rep->value_len;
+    if (rep->type == XCB_NONE)
+        return;
+    pe->data = replyValue(rep);
+    if (pe->data == NULL) {
+        pe->type = None;
+        pe->nitems = 0;
+    }
+}
+
+// PUBLIC
+
+//
+// request properties "props" of all windows "wins" at once,
+// then collect all replies.
+// missing windows and properties are remembered as missing too.
+// properties already in the batch aren't requested again.
+// results are kept until dropPrefetchedProperties,
+// or until PropertyNotify for watched windows.
+// return number of stored results
+//
+int prefetchProperties(Window * wins, int nwins, Atom * props, int nprops)
+{
+    xcb_connection_t *xc;
+    xcb_get_property_cookie_t *ck;
+    xcb_get_property_reply_t *rep;
+    xcb_generic_error_t *err;
+    PropEntry *pe;
+    WatchedWindow *ww;
+    PropKey k;
+    bool *sent, *w;
+    int i, p, n, stored = 0;
+
+    if (nwins <= 0 || nprops <= 0)
+        return 0;
+    xc = XGetXCBConnection(dpy);
+    ck = malloc(nwins * nprops * sizeof(xcb_get_property_cookie_t));
+    sent = malloc(nwins * nprops * sizeof(bool));
+    w = malloc(nwins * sizeof(bool));
+    if (ck == NULL || sent == NULL || w == NULL) {
+        free(ck);
+        free(sent);
+        free(w);
+        return 0;
+    }
+    memset(&k, 0, sizeof(k));
+    for (i = 0; i < nwins; i++) {
+        // a change after this point will be notified
+        HASH_FIND(hh, watched, &(wins[i]), sizeof(Window), ww);
+        w[i] = (ww != NULL);
+        for (p = 0; p < nprops; p++) {
+            n = i * nprops + p;
+            k.win = wins[i];
+            k.prop = props[p];
+            HASH_FIND(hh, prefetched, &k, sizeof(PropKey), pe);
+            sent[n] = (pe == NULL);
+            if (sent[n])
+                ck[n] = xcb_get_property(xc, 0, wins[i], props[p],
+                                         XCB_GET_PROPERTY_TYPE_ANY, 0,
+                                         MAXPROPLEN / 4);
+        }
+    }
+    for (i = 0; i < nwins; i++) {
+        for (p = 0; p < nprops; p++) {
+            n = i * nprops + p;
+            if (!sent[n])
+                continue;
+            err = NULL;
+            rep = xcb_get_property_reply(xc, ck[n], &err);
+            // window may be gone meanwhile: that's an error in reply,
+            // not in Xlib error handler
+            free(err);
+            pe = malloc(sizeof(PropEntry));
+            if (pe == NULL) {
+                free(rep);
+                continue;
+            }
+            memset(pe, 0, sizeof(PropEntry));
+            pe->key.win = wins[i];
+            pe->key.prop = props[p];
+            pe->type = None;
+            pe->watched = w[i];
+            if (rep != NULL)
+                storeReply(pe, rep);
+            free(rep);
+            HASH_ADD(hh, prefetched, key, sizeof(PropKey), pe);
+            stored++;
+        }
+    }
+    free(ck);
+    free(sent);
+    free(w);
+    msg(1, "prefetched %d properties of %d windows\n", stored, nwins);
+    return stored;
+}
+
+//
+// XGetWindowProperty, but X error is detected per request,
+// without XSync and Xlib error handler.
+// offset and length are in 32-bit units.
+// return false on error (f.e., no such window),
+// otherwise true and the same values as XGetWindowProperty returns.
+// *data is malloc'ed, and NULL if there is no property of this type.
+//
+bool checked_x_property(Window win, Atom prop, Atom type,
+                        long offset, long length, Atom * ret_type,
+                        int *format, unsigned long *nitems,
+                        unsigned long *bytes_after, unsigned char **data)
+{
+    xcb_connection_t *xc;
+    xcb_get_property_reply_t *rep;
+    xcb_generic_error_t *err = NULL;
+
+    *data = NULL;
+    xc = XGetXCBConnection(dpy);
+    rep = xcb_get_property_reply(xc,
+                                 xcb_get_property(xc, 0, win, prop, type,
+                                                  offset, length), &err);
+    if (err != NULL || rep == NULL) {
+        if (err != NULL)
+            msg(1, "property %lu of window %lx: X error %d\n",
+                prop, win, err->error_code);
+        free(err);
+        free(rep);
+        return false;
+    }
+    *ret_type = rep->type;
+    *format = rep->format;
+    *nitems = rep->value_len;
+    *bytes_after = rep->bytes_after;
+    // like Xlib, no value if type doesn't match
+    if (rep->type != XCB_NONE && (type == AnyPropertyType || type == rep->type))
+        *data = replyValue(rep);
+    else
+        *nitems = 0;
+    free(rep);
+    return true;
+}
+
+//
+// property of window from prefetchProperties batch.
+// return false if it isn't in the batch,
+// otherwise true and the same type, format, nitems and data
+// as XGetWindowProperty with MAXPROPLEN would return.
+// data belongs to the batch and is NULL if property doesn't exist.
+//
+bool prefetched_x_property(Window win, Atom prop, Atom * type, int *format,
+                           unsigned long *nitems, unsigned char **data)
+{
+    PropKey k;
+    PropEntry *pe;
+
+    if (prefetched == NULL)
+        return false;
+    memset(&k, 0, sizeof(k));
+    k.win = win;
+    k.prop = prop;
+    HASH_FIND(hh, prefetched, &k, sizeof(PropKey), pe);
+    if (pe == NULL)
+        return false;
+    *type = pe->type;
+    *format = pe->format;
+    *nitems = pe->nitems;
+    *data = pe->data;
+    return true;
+}
+
+//
+// forget prefetchProperties results which aren't kept up to date
+// by PropertyNotify, so that get_x_property reads current values again
+//
+void dropPrefetchedProperties(void)
+{
+    PropEntry *pe, *tmp;
+
+    HASH_ITER(hh, prefetched, pe, tmp) {
+        if (!pe->watched)
+            dropEntry(pe);
+    }
+}
+
+//
+// tell that PropertyChangeMask is selected on window w,
+// so its properties may be kept by prefetchProperties
+//
+void watchProperties(Window w)
+{
+    WatchedWindow *ww;
+
+    HASH_FIND(hh, watched, &w, sizeof(Window), ww);
+    if (ww != NULL)
+        return;
+    ww = malloc(sizeof(WatchedWindow));
+    if (ww == NULL)
+        return;
+    ww->id = w;
+    HASH_ADD(hh, watched, id, sizeof(Window), ww);
+}
+
+//
+// is PropertyChangeMask selected on window w, see watchProperties
+//
+bool watchingProperties(Window w)
+{
+    WatchedWindow *ww;
+
+    HASH_FIND(hh, watched, &w, sizeof(Window), ww);
+    return ww != NULL;
+}
+
+//
+// PropertyNotify handler: the kept value is outdated
+//
+void forgetProperty(Window w, Atom prop)
+{
+    PropKey k;
+    PropEntry *pe;
+
+    memset(&k, 0, sizeof(k));
+    k.win = w;
+    k.prop = prop;
+    HASH_FIND(hh, prefetched, &k, sizeof(PropKey), pe);
+    if (pe != NULL)
+        dropEntry(pe);
+}
+
+//
+// window is gone: forget it and all its properties
+//
+void forgetWindowProperties(Window w)
+{
+    WatchedWindow *ww;
+    PropEntry *pe, *tmp;
+
+    HASH_FIND(hh, watched, &w, sizeof(Window), ww);
+    if (ww == NULL)
+        return;                 // properties of unwatched windows aren't kept
+    HASH_DEL(watched, ww);
+    free(ww);
+    HASH_ITER(hh, prefetched, pe, tmp) {
+        if (pe->key.win == w)
+            dropEntry(pe);
+    }
+}
+
+//
+// free everything
+//
+void shutdownProperties(void)
+{
+    WatchedWindow *ww, *wtmp;
+    PropEntry *pe, *tmp;
+
+    HASH_ITER(hh, prefetched, pe, tmp) {
+        dropEntry(pe);
+    }
+    HASH_ITER(hh, watched, ww, wtmp) {
+        HASH_DEL(watched, ww);
+        free(ww);
+    }
+}
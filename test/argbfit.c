@@ -0,0 +1,125 @@
+/*
+Unit test: client side scaling of ARGB icons, argbFit and fitRect
+(util.c).
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include "alttab.h"
+#include "util.h"
+#include "tap.h"
+
+#define RED     0xffff0000
+#define BLACK   0xff000000
+#define WHITE   0xffffffff
+#define NONE    0x00000000
+
+//
+// fill w x h image with one color
+//
+static void fill(uint32_t * p, unsigned int w, unsigned int h, uint32_t c)
+{
+    unsigned int i;
+
+    for (i = 0; i < w * h; i++)
+        p[i] = c;
+}
+
+//
+// check that the x0..x1-1, y0..y1-1 part of w-wide image is color c
+//
+static bool isRect(uint32_t * p, unsigned int w, unsigned int x0,
+                   unsigned int y0, unsigned int x1, unsigned int y1,
+                   uint32_t c)
+{
+    unsigned int x, y;
+
+    for (y = y0; y < y1; y++)
+        for (x = x0; x < x1; x++)
+            if (p[y * w + x] != c) {
+                printf("# pixel %u,%u is %08x, not %08x\n", x, y,
+                       p[y * w + x], c);
+                return false;
+            }
+    return true;
+}
+
+int main(void)
+{
+    uint32_t src[16], dst[16];
+    bool ok;
+
+    tapPlan(8);
+
+    fill(src, 4, 4, RED);
+    fill(dst, 4, 4, WHITE);
+    ok = argbFit(src, 4, 4, dst, 2, 2) == 1 && isRect(dst, 2, 0, 0, 2, 2, RED);
+    tapOk(ok, "square downscale keeps the color");
+
+    fill(src, 1, 1, RED);
+    ok = argbFit(src, 1, 1, dst, 3, 3) == 1 && isRect(dst, 3, 0, 0, 3, 3, RED);
+    tapOk(ok, "square upscale fills the whole dst");
+
+    // 2x2 checker of black and white averages to grey
+    src[0] = src[3] = BLACK;
+    src[1] = src[2] = WHITE;
+    ok = argbFit(src, 2, 2, dst, 1, 1) == 1 && dst[0] == 0xff7f7f7f;
+    tapOk(ok, "downscale averages source pixels");
+
+    // wide 4x2 into 4x4: 4x2 in the middle, margins are transparent
+    fill(src, 4, 2, RED);
+    fill(dst, 4, 4, WHITE);
+    ok = argbFit(src, 4, 2, dst, 4, 4) == 1
+        && isRect(dst, 4, 0, 0, 4, 1, NONE)
+        && isRect(dst, 4, 0, 1, 4, 3, RED)
+        && isRect(dst, 4, 0, 3, 4, 4, NONE);
+    tapOk(ok, "wide image is centered vertically");
+
+    // tall 2x4 into 4x4
+    fill(src, 2, 4, RED);
+    fill(dst, 4, 4, WHITE);
+    ok = argbFit(src, 2, 4, dst, 4, 4) == 1
+        && isRect(dst, 4, 0, 0, 1, 4, NONE)
+        && isRect(dst, 4, 1, 0, 3, 4, RED)
+        && isRect(dst, 4, 3, 0, 4, 4, NONE);
+    tapOk(ok, "tall image is centered horizontally");
+
+    // 8x2 into 4x4: aspect is kept when downscaling too
+    fill(src, 8, 2, RED);
+    fill(dst, 4, 4, WHITE);
+    ok = argbFit(src, 8, 2, dst, 4, 4) == 1
+        && isRect(dst, 4, 0, 0, 4, 1, NONE)
+        && isRect(dst, 4, 0, 1, 4, 2, RED)
+        && isRect(dst, 4, 0, 2, 4, 4, NONE);
+    tapOk(ok, "wide image is downscaled with its aspect ratio");
+
+    // one pixel short of square is taken as square, see fitRect
+    fill(src, 4, 3, RED);
+    fill(dst, 4, 4, WHITE);
+    ok = argbFit(src, 4, 3, dst, 4, 4) == 1 && isRect(dst, 4, 0, 0, 4, 4, RED);
+    tapOk(ok, "rounding error of one pixel is suppressed");
+
+    ok = argbFit(src, 0, 4, dst, 4, 4) == 0
+        && argbFit(src, 4, 4, dst, 4, 0) == 0;
+    tapOk(ok, "empty src or dst is refused");
+
+    return tapDone();
+}
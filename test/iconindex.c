@@ -0,0 +1,204 @@
+/*
+Unit test: persistent icon index round trip and rejection of
+stale or corrupt index (iconcache.c).
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include "alttab.h"
+#include "icon.h"
+#include "tap.h"
+extern Globals g;
+
+#define THEME   "alttab-test-theme"
+
+// offsets in the index file, see iconindex_*_t in iconcache.c
+#define HDR_NDIRS       16
+#define HDR_STRSIZE     24
+#define HDR_SIZE        32
+#define DIR_SIZE        24
+#define ICON_EXT        16
+
+//
+// copy index file, optionally truncated or with one byte changed
+// 1=success
+//
+static int copyIndex(const char *from, const char *to, long truncate,
+                     long poke, unsigned char value)
+{
+    FILE *f;
+    unsigned char *buf;
+    long size;
+    int ret = 0;
+
+    if ((f = fopen(from, "r")) == NULL)
+        return 0;
+    fseek(f, 0, SEEK_END);
+    size = ftell(f);
+    rewind(f);
+    buf = malloc(size);
+    if (buf == NULL || fread(buf, 1, size, f) != size) {
+        fclose(f);
+        free(buf);
+        return 0;
+    }
+    fclose(f);
+    if (truncate > 0 && truncate < size)
+        size = truncate;
+    if (poke >= 0 && poke < size)
+        buf[poke] = value;
+    if ((f = fopen(to, "w")) != NULL) {
+        ret = (fwrite(buf, 1, size, f) == size);
+        ret = (fclose(f) == 0) && ret;
+    }
+    free(buf);
+    return ret;
+}
+
+//
+// is there the same file of the same size in ic->sizes?
+//
+static bool hasSize(icon_t * ic, iconsize_t * sz)
+{
+    int s;
+
+    for (s = 0; s < ic->nsizes; s++) {
+        if (strcmp(ic->sizes[s].src_dir, sz->src_dir) == 0
+            && strcmp(ic->sizes[s].src_name, sz->src_name) == 0
+            && ic->sizes[s].src_w == sz->src_w
+            && ic->sizes[s].src_h == sz->src_h
+            && ic->sizes[s].ext == sz->ext && ic->sizes[s].dir == sz->dir)
+            return true;
+    }
+    return false;
+}
+
+//
+// do both hashes hold the same apps with the same files?
+// order of sizes doesn't matter
+//
+static bool sameIcons(icon_t * a, icon_t * b)
+{
+    icon_t *ia, *ib, *tmp;
+    char pa[MAXICONPATHLEN], pb[MAXICONPATHLEN];
+    int s;
+
+    if (HASH_COUNT(a) != HASH_COUNT(b))
+        return false;
+    HASH_ITER(hh, a, ia, tmp) {
+        HASH_FIND_STR(b, ia->app, ib);
+        if (ib == NULL
+            || strcmp(iconSrcPath(ia, pa), iconSrcPath(ib, pb)) != 0
+            || ia->src_w != ib->src_w || ia->src_h != ib->src_h
+            || ia->ext != ib->ext || ia->dir != ib->dir
+            || ia->nsizes != ib->nsizes)
+            return false;
+        for (s = 0; s < ia->nsizes; s++) {
+            if (!hasSize(ib, &(ia->sizes[s])))
+                return false;
+        }
+    }
+    return true;
+}
+
+int main(void)
+{
+    char *tmp;
+    char home[MAXICONPATHLEN], cache[MAXICONPATHLEN];
+    char idx[MAXICONPATHLEN], bad[MAXICONPATHLEN + 8];
+    icon_t *scanned = NULL, *loaded = NULL, *ic;
+    icondirlist_t dl = { NULL, 0, 0 };
+    FILE *f;
+    uint32_t ndirs = 0;
+
+    tapPlan(9);
+    tmp = tapTmpDir();
+    if (tmp == NULL) {
+        fprintf(stderr, "can't create scratch dir\n");
+        return 1;
+    }
+    snprintf(home, sizeof(home), "%s/home", tmp);
+    snprintf(cache, sizeof(cache), "%s/cache", tmp);
+    setenv("HOME", home, 1);
+    setenv("XDG_CACHE_HOME", cache, 1);
+    unsetenv("XDG_DATA_DIRS");
+    g.option_theme = THEME;
+    g.option_iconW = g.option_iconH = 32;
+
+    tapWriteFile(home, ".icons/" THEME "/32x32/apps/foo.png", "");
+    tapWriteFile(home, ".icons/" THEME "/48x48/apps/foo.png", "");
+    tapWriteFile(home, ".icons/" THEME "/16x16/apps/bar.xpm", "");
+
+    updateIconsFromFile(&scanned, &dl);
+    HASH_FIND_STR(scanned, "foo", ic);
+    tapOk(ic != NULL && ic->src_w == 32 && ic->nsizes == 2,
+          "scan finds both sizes of foo, 32x32 is the best");
+
+    tapOk(iconIndexPath(idx, sizeof(idx), false)
+          && saveIconIndex(scanned, &dl, idx), "index is saved");
+
+    tapOk(loadIconIndex(&loaded, idx) && sameIcons(scanned, loaded),
+          "index loads the same icons");
+    deleteIconHash(&loaded);
+
+    g.option_iconH = 48;
+    tapOk(!loadIconIndex(&loaded, idx) && loaded == NULL,
+          "index for another icon size is rejected");
+    g.option_iconH = 32;
+
+    snprintf(bad, sizeof(bad), "%s.bad", idx);
+    tapOk(copyIndex(idx, bad, 50, -1, 0)
+          && !loadIconIndex(&loaded, bad) && loaded == NULL,
+          "truncated index is rejected");
+
+    if ((f = fopen(idx, "r")) != NULL) {
+        if (fseek(f, HDR_NDIRS, SEEK_SET) == 0)
+            ndirs = (fread(&ndirs, sizeof(ndirs), 1, f) == 1) ? ndirs : 0;
+        fclose(f);
+    }
+    tapOk(copyIndex(idx, bad, 0, HDR_SIZE + ndirs * DIR_SIZE + ICON_EXT, 77)
+          && !loadIconIndex(&loaded, bad) && loaded == NULL,
+          "index with unknown icon ext is rejected");
+
+    tapOk(copyIndex(idx, bad, 0, HDR_STRSIZE, 0xff)
+          && !loadIconIndex(&loaded, bad) && loaded == NULL,
+          "index with wrong string table size is rejected");
+
+    // new file changes mtime of its directory
+    usleep(20000);
+    tapWriteFile(home, ".icons/" THEME "/32x32/apps/baz.png", "");
+    tapOk(!loadIconIndex(&loaded, idx) && loaded == NULL,
+          "index is stale after an icon dir changed");
+
+    freeIconDirList(&dl);
+    deleteIconHash(&scanned);
+    updateIconsFromFile(&scanned, &dl);
+    HASH_FIND_STR(scanned, "baz", ic);
+    tapOk(ic != NULL && saveIconIndex(scanned, &dl, idx)
+          && loadIconIndex(&loaded, idx) && sameIcons(scanned, loaded),
+          "rebuilt index is fresh again");
+
+    deleteIconHash(&scanned);
+    deleteIconHash(&loaded);
+    freeIconDirList(&dl);
+    return tapDone();
+}
@@ -0,0 +1,117 @@
+/*
+Benchmark: lookupIcon through flat table vs HASH_FIND_STR
+of lowercased name, as lookupIcon did before, over a big icon hash.
+Not run by make check; build with "make -C test iconlookup"
+and run "test/iconlookup [apps] [rounds]".
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <time.h>
+#include "alttab.h"
+#include "icon.h"
+extern Globals g;
+
+#define NAMELEN     32
+
+static double now(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+//
+// the way lookupIcon worked before the flat table
+//
+static icon_t *lookupIconHash(char *app)
+{
+    icon_t *ic;
+    char appl[MAXAPPLEN];
+    int l;
+
+    for (l = 0; app[l] != '\0' && l < MAXAPPLEN - 1; l++)
+        appl[l] = tolower((unsigned char)app[l]);
+    appl[l] = '\0';
+    HASH_FIND_STR(g.ic, appl, ic);
+    return ic;
+}
+
+int main(int argc, char **argv)
+{
+    int napps = argc > 1 ? atoi(argv[1]) : 20000;
+    int rounds = argc > 2 ? atoi(argv[2]) : 50;
+    char (*names)[NAMELEN];
+    char *keys;
+    icon_t *ic;
+    double t;
+    int i, r, found;
+
+    if (napps <= 0 || rounds <= 0) {
+        fprintf(stderr, "usage: %s [apps] [rounds]\n", argv[0]);
+        return 1;
+    }
+    // WM_CLASS as windows report it: mixed case; half of them are misses
+    names = malloc(2 * napps * NAMELEN);
+    keys = malloc(napps * NAMELEN);
+    if (names == NULL || keys == NULL)
+        return 1;
+    g.ic = NULL;
+    for (i = 0; i < napps; i++) {
+        ic = initIcon();
+        if (ic == NULL)
+            return 1;
+        snprintf(keys + i * NAMELEN, NAMELEN, "org.example.app%06d", i);
+        ic->app = keys + i * NAMELEN;
+        HASH_ADD_KEYPTR(hh, g.ic, ic->app, strlen(ic->app), ic);
+        snprintf(names[2 * i], NAMELEN, "Org.Example.App%06d", i);
+        snprintf(names[2 * i + 1], NAMELEN, "Org.Example.Missing%06d", i);
+    }
+
+    t = now();
+    invalidateIconTable();
+    lookupIcon(names[0]);
+    printf("table build:   %d apps, %.3f ms\n", napps, (now() - t) * 1e3);
+
+    found = 0;
+    t = now();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < 2 * napps; i++)
+            found += lookupIcon(names[i]) != NULL;
+    t = now() - t;
+    printf("lookupIcon:    %d lookups, %d found, %.1f ns/lookup\n",
+           rounds * 2 * napps, found, t * 1e9 / (rounds * 2.0 * napps));
+
+    found = 0;
+    t = now();
+    for (r = 0; r < rounds; r++)
+        for (i = 0; i < 2 * napps; i++)
+            found += lookupIconHash(names[i]) != NULL;
+    t = now() - t;
+    printf("HASH_FIND_STR: %d lookups, %d found, %.1f ns/lookup\n",
+           rounds * 2 * napps, found, t * 1e9 / (rounds * 2.0 * napps));
+
+    deleteIconHash(&g.ic);
+    free(names);
+    free(keys);
+    return 0;
+}
@@ -0,0 +1,109 @@
+/*
+Unit test: icon hash follows changes of icon dirs (iconwatch.c).
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "alttab.h"
+#include "icon.h"
+#include "tap.h"
+extern Globals g;
+
+#define THEME   "alttab-test-theme"
+#define APPS    ".local/share/icons/" THEME
+
+//
+// let inotify deliver, then apply
+//
+static void settle(void)
+{
+    usleep(20000);
+    processIconWatch(&(g.ic));
+}
+
+int main(void)
+{
+    char *tmp;
+    char home[MAXICONPATHLEN / 2], path[MAXICONPATHLEN];
+    char link[MAXICONPATHLEN];
+    icon_t *foo, *ic;
+
+    tapPlan(7);
+    tmp = tapTmpDir();
+    if (tmp == NULL) {
+        fprintf(stderr, "can't create scratch dir\n");
+        return 1;
+    }
+    snprintf(home, sizeof(home), "%s/home", tmp);
+    setenv("HOME", home, 1);
+    setenv("XDG_CACHE_HOME", tmp, 1);
+    unsetenv("XDG_DATA_DIRS");
+    g.option_theme = THEME;
+    g.option_iconW = g.option_iconH = 32;
+
+    tapWriteFile(home, APPS "/32x32/apps/foo.png", "");
+    tapWriteFile(home, APPS "/48x48/apps/foo.png", "");
+    // ~/.icons/THEME is watched as root first, then as 64x64/apps
+    tapWriteFile(home, APPS "/64x64/apps/README", "");
+    snprintf(path, sizeof(path), "%s/" APPS "/64x64/apps", home);
+    snprintf(link, sizeof(link), "%s/.icons/" THEME, home);
+    tapWriteFile(home, ".icons/README", "");
+    if (symlink(path, link) == -1)
+        fprintf(stderr, "can't link %s\n", link);
+    startIconHash();
+    pollIconHash(true);
+    HASH_FIND_STR(g.ic, "foo", foo);
+    tapOk(foo != NULL && foo->nsizes == 2 && foo->src_w == 32,
+          "foo has two sizes, 32x32 is the source");
+
+    tapWriteFile(home, APPS "/16x16/apps/bar.png", "");
+    settle();
+    HASH_FIND_STR(g.ic, "bar", ic);
+    tapOk(ic != NULL, "new icon file is taken");
+
+    tapWriteFile(home, APPS "/64x64/apps/qux.png", "");
+    settle();
+    HASH_FIND_STR(g.ic, "qux", ic);
+    tapOk(ic != NULL, "icon dir reached as theme root too is watched");
+
+    snprintf(path, sizeof(path), "%s/" APPS "/32x32/apps/foo.png", home);
+    unlink(path);
+    settle();
+    HASH_FIND_STR(g.ic, "foo", ic);
+    tapOk(ic == foo && foo->nsizes == 1 && foo->src_w == 48,
+          "removed size is dropped, the icon is kept with the other one");
+
+    snprintf(path, sizeof(path), "%s/" APPS "/48x48/apps/foo.png", home);
+    unlink(path);
+    settle();
+    HASH_FIND_STR(g.ic, "foo", ic);
+    tapOk(ic == NULL, "icon without files is dropped");
+
+    // what is done on inotify queue overflow
+    tapWriteFile(home, APPS "/32x32/apps/baz.png", "");
+    tapOk(rescanIconHash() && pollIconHash(true), "rescan is done");
+    HASH_FIND_STR(g.ic, "baz", ic);
+    tapOk(ic != NULL, "rescan finds icons");
+
+    closeIconWatch();
+    deleteIconHash(&(g.ic));
+    return tapDone();
+}
@@ -0,0 +1,53 @@
+#!/bin/sh
+
+# Run unit test program $1, which needs X server, in headless X server.
+# Skipped if there is no Xvfb, see run-in-xvfb.test to install it.
+# Usage from NAME.test: exec "${0%/*}/in-xvfb.sh" ./NAME
+
+# Copyright 2017-2025 Alexander Kulak.
+# This file is part of alttab program.
+#
+# alttab is free software: you can redistribute it and/or modify
+# it under the terms of the GNU General Public License as published by
+# the Free Software Foundation, either version 3 of the License, or
+# (at your option) any later version.
+#
+# alttab is distributed in the hope that it will be useful,
+# but WITHOUT ANY WARRANTY; without even the implied warranty of
+# MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+# GNU General Public License for more details.
+#
+# You should have received a copy of the GNU General Public License
+# along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+
+
+stop_x()
+{
+    if [ -n "$xvfb" ] ; then
+        kill $xvfb
+        wait $xvfb
+        xvfb=""
+    fi
+    rm -f "$dispfile"
+}
+
+if ! which Xvfb >/dev/null ; then
+    echo "1..0 # SKIP Xvfb not found"
+    exit 0
+fi
+trap stop_x EXIT
+# Xvfb picks a free display and tells its number when ready,
+# so tests may run in parallel
+dispfile=`mktemp`
+Xvfb -displayfd 3 -ac 3>"$dispfile" >/dev/null 2>&1 &
+xvfb=$!
+for ms100 in `seq 1 50` ; do
+    sleep 0.1
+    disp=`cat "$dispfile"`
+    if [ -n "$disp" ] ; then
+        DISPLAY=":$disp" "$1"
+        exit $?
+    fi
+done
+echo "Can't recognize Xvfb in 5 seconds. Bail out!"
+exit 1
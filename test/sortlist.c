@@ -0,0 +1,183 @@
+/*
+Unit test: order of winlist by sortlist ranks (sortWinlist, win.c)
+and removal of windows gone unnoticed (compactSortlist).
+Needs X server, see sortlist.test.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include <X11/Xatom.h>
+#include <utlist.h>
+#include "alttab.h"
+#include "tap.h"
+extern Globals g;
+extern Display *dpy;
+extern int scr;
+extern Window root;
+
+static int ignoreErrors(Display * d, XErrorEvent * e)
+{
+    return 0;
+}
+
+//
+// names of winlist, as shown, joined into buf
+//
+static char *shown(char *buf, size_t size)
+{
+    int i;
+
+    buf[0] = '\0';
+    initWinlist();
+    for (i = 0; i < g.maxNdx; i++) {
+        if (i > 0)
+            strncat(buf, " ", size - strlen(buf) - 1);
+        strncat(buf, g.winlist[i].name, size - strlen(buf) - 1);
+    }
+    freeWinlist();
+    return buf;
+}
+
+//
+// ranks of the last initWinlist are positions in sortlist
+//
+static bool ranksFollowSortlist(void)
+{
+    PermanentWindowInfo *s;
+    int i = 0;
+
+    DL_FOREACH(g.sortlist, s) {
+        if (s->rank != i++)
+            return false;
+    }
+    return i > 0;
+}
+
+static int sortlistLength(void)
+{
+    PermanentWindowInfo *s;
+    int n;
+
+    DL_COUNT(g.sortlist, s, n);
+    return n;
+}
+
+//
+// add n windows to sortlist, which are destroyed
+// before we see DestroyNotify, return the first one
+//
+static Window addGoneWindows(int n)
+{
+    Window w, first = None;
+    int i;
+
+    for (i = 0; i < n; i++) {
+        w = XCreateSimpleWindow(dpy, root, 0, 0, 10, 10, 0, 0, 0);
+        addToSortlist(w, false, false);
+        XDestroyWindow(dpy, w);
+        if (first == None)
+            first = w;
+    }
+    XSync(dpy, False);
+    return first;
+}
+
+static Window newWindow(const char *name)
+{
+    Window w;
+
+    w = XCreateSimpleWindow(dpy, root, 0, 0, 100, 100, 0, 0, 0);
+    XStoreName(dpy, w, name);
+    XMapWindow(dpy, w);
+    return w;
+}
+
+int main(void)
+{
+    Window a, b, c, gone;
+    Window keep[3];
+    char buf[256];
+
+    dpy = XOpenDisplay(NULL);
+    if (dpy == NULL) {
+        tapSkipAll("no X display");
+        return 0;
+    }
+    tapPlan(9);
+    XSetErrorHandler(ignoreErrors);
+    scr = DefaultScreen(dpy);
+    root = RootWindow(dpy, scr);
+    g.option_wm = WM_NO;
+    g.option_max_reclevel = 1;
+    g.option_iconSrc = ISRC_NONE;
+    g.option_screen = SCR_ALL;
+    g.atom[AT_NET_WM_STATE] = XInternAtom(dpy, "_NET_WM_STATE", False);
+    g.atom[AT_NET_WM_STATE_HIDDEN] =
+        XInternAtom(dpy, "_NET_WM_STATE_HIDDEN", False);
+
+    a = newWindow("a");
+    b = newWindow("b");
+    c = newWindow("c");
+    XSync(dpy, False);
+    if (!startupWintasks()) {
+        fprintf(stderr, "can't mirror window tree\n");
+        return 1;
+    }
+    tapOk(strcmp(shown(buf, sizeof(buf)), "a b c") == 0,
+          "new windows are in the order found: %s", buf);
+    tapOk(ranksFollowSortlist(), "ranks are positions in sortlist");
+
+    // as on focus change
+    addToSortlist(c, true, true);
+    tapOk(strcmp(shown(buf, sizeof(buf)), "c a b") == 0,
+          "focused window is first: %s", buf);
+
+    XChangeProperty(dpy, a, g.atom[AT_NET_WM_STATE], XA_ATOM, 32,
+                    PropModeReplace,
+                    (unsigned char *)&(g.atom[AT_NET_WM_STATE_HIDDEN]), 1);
+    XSync(dpy, False);
+    tapOk(strcmp(shown(buf, sizeof(buf)), "c a b") == 0,
+          "minimized window keeps its place by default: %s", buf);
+    g.option_sort_minimize = true;
+    tapOk(strcmp(shown(buf, sizeof(buf)), "c b a") == 0,
+          "minimized window is last with sort_minimize: %s", buf);
+
+    keep[0] = a;
+    keep[1] = b;
+    keep[2] = c;
+    addGoneWindows(10);
+    compactSortlist(keep, 3);
+    tapOk(sortlistLength() == 13, "a few gone windows are kept for now");
+    gone = addGoneWindows(40);
+    compactSortlist(keep, 3);
+    tapOk(sortlistLength() == 3, "many gone windows are removed");
+    tapOk(strcmp(shown(buf, sizeof(buf)), "c b a") == 0,
+          "order of windows kept is the same: %s", buf);
+    addToSortlist(gone, false, false);
+    tapOk(sortlistLength() == 4 && g.sortlist->prev->id == gone,
+          "removed window is added again at the tail");
+
+    XDestroyWindow(dpy, a);
+    XDestroyWindow(dpy, b);
+    XDestroyWindow(dpy, c);
+    XCloseDisplay(dpy);
+    return tapDone();
+}
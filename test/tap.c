@@ -0,0 +1,126 @@
+/*
+Minimal TAP producer for unit tests, see tap-driver.sh.
+Also provides the globals which alttab.c defines in the program.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#define _GNU_SOURCE
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "alttab.h"
+#include "tap.h"
+
+Globals g;
+Display *dpy;
+int scr;
+Window root;
+
+// PRIVATE
+
+static int planned = 0;
+static int ran = 0;
+static int failed = 0;
+static char *tmpdir = NULL;
+
+// PUBLIC
+
+void tapPlan(int n)
+{
+    planned = n;
+    printf("1..%d\n", n);
+    fflush(stdout);
+}
+
+//
+// report test result, return cond
+//
+bool tapOk(bool cond, const char *fmt, ...)
+{
+    va_list ap;
+
+    ran++;
+    if (!cond)
+        failed++;
+    printf("%s %d - ", cond ? "ok" : "not ok", ran);
+    va_start(ap, fmt);
+    vprintf(fmt, ap);
+    va_end(ap);
+    printf("\n");
+    fflush(stdout);
+    return cond;
+}
+
+void tapSkipAll(const char *why)
+{
+    printf("1..0 # SKIP %s\n", why);
+    fflush(stdout);
+}
+
+int tapDone(void)
+{
+    char cmd[1024];
+
+    if (tmpdir != NULL) {
+        snprintf(cmd, sizeof(cmd), "rm -rf '%s'", tmpdir);
+        if (system(cmd) != 0)
+            fprintf(stderr, "can't remove %s\n", tmpdir);
+        free(tmpdir);
+        tmpdir = NULL;
+    }
+    if (ran != planned)
+        fprintf(stderr, "planned %d tests, ran %d\n", planned, ran);
+    return (failed == 0 && ran == planned) ? 0 : 1;
+}
+
+//
+// scratch directory, the same for the whole test.
+// NULL on failure
+//
+char *tapTmpDir(void)
+{
+    char tmpl[] = "/tmp/alttab-test-XXXXXX";
+
+    if (tmpdir == NULL && mkdtemp(tmpl) != NULL)
+        tmpdir = strdup(tmpl);
+    return tmpdir;
+}
+
+//
+// write content to dir/name, creating directories in name.
+// 1=success
+//
+int tapWriteFile(const char *dir, const char *name, const char *content)
+{
+    char path[1024], *sl;
+    FILE *f;
+
+    if (snprintf(path, sizeof(path), "%s/%s", dir, name) >= sizeof(path))
+        return 0;
+    for (sl = strchr(path + 1, '/'); sl != NULL;
+         sl = strchr(sl + 1, '/')) {
+        *sl = '\0';
+        mkdir(path, 0755);
+        *sl = '/';
+    }
+    if ((f = fopen(path, "w")) == NULL)
+        return 0;
+    fputs(content, f);
+    return (fclose(f) == 0) ? 1 : 0;
+}
@@ -0,0 +1,35 @@
+/*
+Minimal TAP producer for unit tests, see tap-driver.sh.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef TAP_H
+#define TAP_H
+
+#include <stdbool.h>
+
+void tapPlan(int n);
+bool tapOk(bool cond, const char *fmt, ...);
+void tapSkipAll(const char *why);
+int tapDone(void);              // exit status of the test
+
+// scratch directory, removed by tapDone
+char *tapTmpDir(void);
+int tapWriteFile(const char *dir, const char *name, const char *content);
+
+#endif
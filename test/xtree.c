@@ -0,0 +1,159 @@
+/*
+Unit test: mirror of window tree kept by SubstructureNotify events
+(x.c), as used by -w 0 and -w 3. Needs X server, see xtree.test.
+
+Copyright 2017-2025 Alexander Kulak.
+This file is part of alttab program.
+
+alttab is free software: you can redistribute it and/or modify
+it under the terms of the GNU General Public License as published by
+the Free Software Foundation, either version 3 of the License, or
+(at your option) any later version.
+
+alttab is distributed in the hope that it will be useful,
+but WITHOUT ANY WARRANTY; without even the implied warranty of
+MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+GNU General Public License for more details.
+
+You should have received a copy of the GNU General Public License
+along with alttab.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <X11/Xlib.h>
+#include "alttab.h"
+#include "tap.h"
+extern Globals g;
+extern Display *dpy;
+extern int scr;
+extern Window root;
+
+//
+// windows may be gone before the mirror asks for them,
+// alttab ignores such errors too
+//
+static int ignoreErrors(Display * d, XErrorEvent * e)
+{
+    return 0;
+}
+
+//
+// deliver tree events, as the main loop does
+//
+static void settle(void)
+{
+    XEvent ev;
+
+    XSync(dpy, False);
+    while (XPending(dpy)) {
+        XNextEvent(dpy, &ev);
+        switch (ev.type) {
+        case CreateNotify:
+        case DestroyNotify:
+        case MapNotify:
+        case UnmapNotify:
+        case ReparentNotify:
+        case ConfigureNotify:
+        case CirculateNotify:
+            x_treeEvent(&ev);
+            break;
+        }
+    }
+}
+
+//
+// how many times window named so is in winlist built from the mirror
+//
+static int listed(const char *name)
+{
+    int i, n = 0;
+
+    initWinlist();
+    for (i = 0; i < g.maxNdx; i++)
+        if (strcmp(g.winlist[i].name, name) == 0)
+            n++;
+    freeWinlist();
+    return n;
+}
+
+static Window newWindow(Window parent, const char *name)
+{
+    Window w;
+
+    w = XCreateSimpleWindow(dpy, parent, 0, 0, 100, 100, 0, 0, 0);
+    if (name != NULL)
+        XStoreName(dpy, w, name);
+    XMapWindow(dpy, w);
+    return w;
+}
+
+int main(void)
+{
+    Window frame, client, deep, frame2, outer;
+
+    dpy = XOpenDisplay(NULL);
+    if (dpy == NULL) {
+        tapSkipAll("no X display");
+        return 0;
+    }
+    tapPlan(7);
+    XSetErrorHandler(ignoreErrors);
+    scr = DefaultScreen(dpy);
+    root = RootWindow(dpy, scr);
+    // twm: named windows at any depth
+    g.option_wm = WM_TWM;
+    g.option_max_reclevel = -1;
+    g.option_iconSrc = ISRC_NONE;
+    g.option_screen = SCR_ALL;
+
+    frame = newWindow(root, NULL);
+    client = newWindow(frame, "client");
+    deep = newWindow(client, "deep");
+    XSync(dpy, False);
+    if (!startupWintasks()) {
+        fprintf(stderr, "can't mirror window tree\n");
+        return 1;
+    }
+    tapOk(listed("client") == 1, "client in frame is found at startup");
+    tapOk(listed("deep") == 1, "window below client is found at startup");
+
+    newWindow(client, "later");
+    settle();
+    tapOk(listed("later") == 1, "window created below client is added");
+
+    XReparentWindow(dpy, deep, root, 0, 0);
+    settle();
+    tapOk(listed("deep") == 1, "window reparented to root is kept once");
+
+    frame2 = newWindow(root, NULL);
+    XReparentWindow(dpy, client, frame2, 0, 0);
+    settle();
+    tapOk(listed("client") == 1 && listed("later") == 1,
+          "client moved into another frame is kept with its subtree");
+
+    XDestroyWindow(dpy, client);
+    settle();
+    tapOk(listed("client") == 0 && listed("later") == 0
+          && listed("deep") == 1,
+          "destroyed window is removed with its subtree");
+
+    // twm mirror selected SubstructureNotify on outer, -w 0 keeps to level 1
+    outer = newWindow(root, "outer");
+    newWindow(outer, "inner");
+    settle();
+    x_shutdownWintasks();
+    g.option_wm = WM_NO;
+    g.option_max_reclevel = 1;
+    x_startupWintasks();
+    tapOk(listed("outer") == 1 && listed("inner") == 0,
+          "mirror is no deeper than max reclevel");
+
+    XDestroyWindow(dpy, outer);
+    XDestroyWindow(dpy, frame);
+    XDestroyWindow(dpy, frame2);
+    XDestroyWindow(dpy, deep);
+    XCloseDisplay(dpy);
+    return tapDone();
+}